@@ -1,74 +1,132 @@
 #include "videoplayer.h"
 #include <QDebug>
 
+// PCM环形缓冲能存多长的声音 单位是毫秒
+#define AUDIO_RING_DURATION_MS 200
+// 环形缓冲满了音频解码线程最多等多久 单位是毫秒, SDL回调取走数据时会唤醒, 超时只是保底
+#define AUDIO_RING_WAIT_MS 50
+// SDL音频缓冲区的样本数, 回调里只拷贝数据, 可以取得比较小, 声音延迟更低
+#define AUDIO_DEVICE_SAMPLES 256
+// 低延迟模式SDL音频缓冲区的样本数
+#define AUDIO_LOW_LATENCY_SAMPLES 128
+// 声卡里排队的缓冲区个数: 正在播放的一个加上刚填充的一个(和ffplay的估计一样)
+#define AUDIO_DEVICE_BUFFERS 2
+// 转换输出缓冲一开始能放多少个样本, 解码出来的Frame更大时再扩大
+#define AUDIO_OUT_SAMPLES 4096
+
+// 解码出来的采样格式对应的SDL格式, 平面存放的也按交错存放的格式打开声卡
+static SDL_AudioFormat sdlAudioFormat(AVSampleFormat fmt) {
+    switch (av_get_packed_sample_fmt(fmt)) {
+    case AV_SAMPLE_FMT_U8: return AUDIO_U8;
+    case AV_SAMPLE_FMT_S16: return AUDIO_S16SYS;
+    case AV_SAMPLE_FMT_S32: return AUDIO_S32SYS;
+    default: return AUDIO_F32SYS;
+    }
+}
+
+// 声卡格式对应的采样格式, 重采样不能直接输出的返回AV_SAMPLE_FMT_NONE
+static AVSampleFormat avSampleFormat(SDL_AudioFormat fmt) {
+    switch (fmt) {
+    case AUDIO_U8: return AV_SAMPLE_FMT_U8;
+    case AUDIO_S16SYS: return AV_SAMPLE_FMT_S16;
+    case AUDIO_S32SYS: return AV_SAMPLE_FMT_S32;
+    case AUDIO_F32SYS: return AV_SAMPLE_FMT_FLT;
+    default: return AV_SAMPLE_FMT_NONE;
+    }
+}
+
 int VideoPlayer::initAudioInfo() {
     // 初始化解码器
-    int ret = initDecoder(&_aDecodeCxt, AVMEDIA_TYPE_AUDIO, &_aStream);
+    int ret = initDecoder(_fmtCxt, &_aDecodeCxt, AVMEDIA_TYPE_AUDIO, &_aStream);
     RET(initDecoder);
+    // 包队列按流的时间基换算缓存时长
+    _aPktQueue->setTimeBase(_aStream->time_base);
+
+    // 初始化SDL, 和声卡协商输出格式
+    // 无界面模式不打开声卡, 输出固定格式, 写出的PCM文件格式不随音源变化
+    if (!_sink) {
+        ret = initSDL();
+        RET(initSDL);
+    }else {
+        setAudioOutSpec(44100, AV_SAMPLE_FMT_S16, 2);
+    }
 
     // 初始化重采样
     ret = initSwr();
     RET(initSwr);
 
-    // 初始化SDL
-    ret = initSDL();
-    RET(initSDL);
+    // 解码线程和SDL回调之间的PCM缓冲, 按时长换算成字节; 变速按声卡格式处理
+    if (!_sink) {
+        int bytesPerSec = _audioOutSpec.sampleRate * _audioOutSpec.bytesPerSampleFrame;
+        _aRing = new PcmRing(bytesPerSec / 1000 * AUDIO_RING_DURATION_MS);
+        _aStretch->init(_audioOutSpec.fmt, _audioOutSpec.chs, _audioOutSpec.sampleRate);
+    }
 
     return 0;
 }
 
 int VideoPlayer::initSDL() {
-    // 设置参数
+    // 设置参数, 按音源原样请求, 48k的视频不用再转成44.1k
     SDL_AudioSpec audioSpec;
+    SDL_zero(audioSpec);
     // 采样率
-    audioSpec.freq = _audioOutSpec.sampleRate;
+    audioSpec.freq = _aDecodeCxt->sample_rate;
     // 声道
-    audioSpec.channels = _audioOutSpec.chs;
+    audioSpec.channels = _aDecodeCxt->channels;
     // 采样大小 位深度
-    audioSpec.format = AUDIO_S16LSB;
+    audioSpec.format = sdlAudioFormat(_aDecodeCxt->sample_fmt);
     // 音频缓存区有多少音频样本,这个数据决定缓冲区的大小, 必须是2的幂. 一般取值1024, 512
-    audioSpec.samples = 512;
+    audioSpec.samples = _lowLatency ? AUDIO_LOW_LATENCY_SAMPLES : AUDIO_DEVICE_SAMPLES;
     // callBack sdl要数据时就回调他
     audioSpec.callback = VideoPlayer::audioSDLCallbackFunc;
     audioSpec.userdata = this;
 
-    // 打开设备
-    int ret = SDL_OpenAudio(&audioSpec, nullptr);
-    if (ret) {
-        qDebug() << "open audio devices error: " << SDL_GetError() << ret;
-        return ret;
+    // 打开设备, 声卡不支持的参数由SDL改成声卡支持的(_aDeviceSpec), SDL内部不再转换, 需要转换时由swr一次做完
+    _aDevice = SDL_OpenAudioDevice(nullptr, 0, &audioSpec, &_aDeviceSpec,
+                                   SDL_AUDIO_ALLOW_FREQUENCY_CHANGE
+                                   | SDL_AUDIO_ALLOW_CHANNELS_CHANGE
+                                   | SDL_AUDIO_ALLOW_FORMAT_CHANGE);
+    if (_aDevice && avSampleFormat(_aDeviceSpec.format) == AV_SAMPLE_FMT_NONE) {
+        // 声卡的格式swr不能直接输出(比如大端), 重新打开, 让SDL从float转换
+        SDL_CloseAudioDevice(_aDevice);
+        audioSpec.format = AUDIO_F32SYS;
+        _aDevice = SDL_OpenAudioDevice(nullptr, 0, &audioSpec, &_aDeviceSpec,
+                                       SDL_AUDIO_ALLOW_FREQUENCY_CHANGE
+                                       | SDL_AUDIO_ALLOW_CHANNELS_CHANGE);
+    }
+    if (!_aDevice) {
+        qDebug() << "open audio devices error: " << SDL_GetError();
+        return -1;
     }
 
+    setAudioOutSpec(_aDeviceSpec.freq, avSampleFormat(_aDeviceSpec.format), _aDeviceSpec.channels);
+    // SDL只告诉我们缓冲区大小, 按排队的缓冲区个数估计从填充到听到的延迟
+    _aDeviceLatency = AUDIO_DEVICE_BUFFERS * (int64_t)_aDeviceSpec.samples * 1000000 / _aDeviceSpec.freq;
+    qDebug() << "audio device:" << _aDeviceSpec.freq << "Hz"
+             << _aDeviceSpec.channels << "chs"
+             << av_get_sample_fmt_name(_audioOutSpec.fmt)
+             << "samples" << _aDeviceSpec.samples
+             << "latency(us)" << _aDeviceLatency;
     return 0;
 }
 
-int VideoPlayer::initSwr() {
-    // 设置采样输入格式
-    _audioInSpec.sampleRate = _aDecodeCxt->sample_rate;
-    _audioInSpec.fmt = _aDecodeCxt->sample_fmt;
-    _audioInSpec.chsLayout = _aDecodeCxt->channel_layout;
-    _audioInSpec.chs = _aDecodeCxt->channels;
-    // 设置采样输出格式
-    _audioOutSpec.sampleRate = 44100;
-    _audioOutSpec.fmt = AV_SAMPLE_FMT_S16;
-    _audioOutSpec.chsLayout = AV_CH_LAYOUT_STEREO;
-    _audioOutSpec.chs = av_get_channel_layout_nb_channels(_audioOutSpec.chsLayout);
+void VideoPlayer::setAudioOutSpec(int sampleRate, AVSampleFormat fmt, int chs) {
+    _audioOutSpec.sampleRate = sampleRate;
+    _audioOutSpec.fmt = fmt;
+    _audioOutSpec.chs = chs;
+    _audioOutSpec.chsLayout = av_get_default_channel_layout(chs);
     // 输出样本帧大小
     _audioOutSpec.bytesPerSampleFrame = _audioOutSpec.chs * av_get_bytes_per_sample(_audioOutSpec.fmt);
+}
 
-    // 创建重采样上下文
-    _aSwrCxt = swr_alloc_set_opts(nullptr,
-                                  _audioOutSpec.chsLayout, _audioOutSpec.fmt, _audioOutSpec.sampleRate,
-                                  _audioInSpec.chsLayout, _audioInSpec.fmt, _audioInSpec.sampleRate,
-                                  0, nullptr);
-    if (!_aSwrCxt) {
-        qDebug() << "swr_alloc_set_opts error";
-        return -1;
-    }
-
-    // 初始化重采样上下文
-    int ret = swr_init(_aSwrCxt);
-    RET(swr_init);
+int VideoPlayer::initSwr() {
+    // 创建重采样上下文, 输出格式在打开声卡时已经确定
+    int ret = initSwrCxt(_aDecodeCxt, _audioInSpec, &_aSwrCxt, &_aConvert);
+    RET(initSwrCxt);
+    qDebug() << "audio convert:"
+             << av_get_sample_fmt_name(_audioInSpec.fmt) << _audioInSpec.sampleRate << "->"
+             << av_get_sample_fmt_name(_audioOutSpec.fmt) << _audioOutSpec.sampleRate
+             << (_aSwrCxt ? "swr" : (_aConvert ? (SampleConverter::isSimd() ? "sse2" : "c") : "none"));
 
     // 初始化Frame
     _aSwrInFrame = av_frame_alloc();
@@ -86,13 +144,64 @@ int VideoPlayer::initSwr() {
     // 由于av_frame_alloc只是创建_aSwrOutFrame->data这个数组,而这个数组指向的缓存区需要自己创建
     // 初始化输出缓冲data[0]的空间.
     // 指定4096是因为每个frame大小不一样, 重采样后输出的数据大小不定.所以输出缓冲区空间搞个大空间囊括.
-    ret = av_samples_alloc((uint8_t **)_aSwrOutFrame->data,
-                           _aSwrOutFrame->linesize,
-                           _audioOutSpec.chs,
-                           4096,
-                           _audioOutSpec.fmt,
-                           1);
+    // 播放列表的下一个文件可能需要重采样, 不需要重采样的文件也分配
+    return allocAudioOutBuffer(AUDIO_OUT_SAMPLES);
+}
+
+int VideoPlayer::allocAudioOutBuffer(int samples) {
+    av_freep(&_aSwrOutFrame->data[0]);
+    int ret = av_samples_alloc((uint8_t **)_aSwrOutFrame->data,
+                               _aSwrOutFrame->linesize,
+                               _audioOutSpec.chs,
+                               samples,
+                               _audioOutSpec.fmt,
+                               1);
     RET(av_samples_alloc);
+    _aSwrOutSamples = samples;
+    return 0;
+}
+
+int VideoPlayer::initSwrCxt(AVCodecContext *decodeCxt,
+                            AudioResampleSpec &inSpec,
+                            SwrContext **swrCxt,
+                            SampleConverter::Func *convert) {
+    // 设置采样输入格式, 没有声道布局的按声道数取默认布局
+    inSpec.sampleRate = decodeCxt->sample_rate;
+    inSpec.fmt = decodeCxt->sample_fmt;
+    inSpec.chs = decodeCxt->channels;
+    inSpec.chsLayout = decodeCxt->channel_layout ? decodeCxt->channel_layout
+                                                 : av_get_default_channel_layout(inSpec.chs);
+    inSpec.bytesPerSampleFrame = inSpec.chs * av_get_bytes_per_sample(inSpec.fmt);
+
+    // 解码出来的就是声卡要的格式(交错存放, 采样率、声道都一样), 不创建重采样上下文, 直接输出解码的数据
+    *swrCxt = nullptr;
+    *convert = nullptr;
+    if (inSpec.fmt == _audioOutSpec.fmt
+            && inSpec.sampleRate == _audioOutSpec.sampleRate
+            && inSpec.chsLayout == _audioOutSpec.chsLayout) {
+        return 0;
+    }
+
+    // 采样率一样, 只是常见的格式、声道转换, 用专用转换代替swr
+    if (inSpec.sampleRate == _audioOutSpec.sampleRate) {
+        *convert = SampleConverter::find(inSpec.fmt, inSpec.chsLayout,
+                                         _audioOutSpec.fmt, _audioOutSpec.chsLayout);
+        if (*convert) return 0;
+    }
+
+    // 创建重采样上下文, 输出格式用_audioOutSpec
+    *swrCxt = swr_alloc_set_opts(nullptr,
+                                 _audioOutSpec.chsLayout, _audioOutSpec.fmt, _audioOutSpec.sampleRate,
+                                 inSpec.chsLayout, inSpec.fmt, inSpec.sampleRate,
+                                 0, nullptr);
+    if (!*swrCxt) {
+        qDebug() << "swr_alloc_set_opts error";
+        return -1;
+    }
+
+    // 初始化重采样上下文
+    int ret = swr_init(*swrCxt);
+    RET(swr_init);
     return 0;
 }
 
@@ -102,82 +211,186 @@ void VideoPlayer::audioSDLCallbackFunc(void *userdata, Uint8 *stream, int len) {
 }
 
 void VideoPlayer::audioSDLCallback(Uint8 *stream, int len) {
+    // 统计填充一次缓冲区的耗时, 太长会出现爆音
+    TRACE_THREAD("audio callback");
+    TRACE_SCOPE("audio fill", _aTime);
+    int64_t fillStart = av_gettime_relative();
+    SDL_memset(stream, _aDeviceSpec.silence, len);
+    // 暂停、停止时SDL音频设备已经暂停, 这里只是防止状态切换瞬间还在回调
+    if (_state != Playing) return;
+
+    // 只从环形缓冲拷贝PCM, 解码和重采样在音频解码线程(见pumpAudio), 回调里不会等待
+    // 音量, 拖动进度条中静音, 不播放零碎的声音
+    int volume = (_mute || _scrubbing) ? 0 : (_volume * 1.0 / Max) * SDL_MIX_MAXVOLUME;
+    int filled = 0;
+    while (filled < len) {
+        // 数据到环形缓冲末尾要分两次取
+        const uint8_t *data = nullptr;
+        int size = _aRing->peek(&data, len - filled);
+        if (size <= 0) break;
+        SDL_MixAudioFormat(stream + filled, data, _aDeviceSpec.format, size, volume);
+        _aRing->consume(size);
+        filled += size;
+    }
 
-    SDL_memset(stream, 0, len);
-    // 因为pkt包的大小不一定一次能填充够sdl索要的缓冲区(len: 缓冲区长度)
-    // 反过来思考: 将赋予len作为剩余要填充缓冲区的长度,作为循环条件判断
-    while (len > 0) {
-        if (_state == Paused) break;
+    if (filled > 0) {
+        // 时钟: 环形缓冲写入末尾的时间戳, 减去环形缓冲里和声卡里还没播放的时长, 就是现在听到的时刻
+        // 变速时每秒声音对应speed秒的时间戳; 两次回调之间由_aClock按单调时钟插值
+        // 只发布锚点, 设置_aClock要加锁, 由读时钟的线程做
+        int bytesPerSec = _audioOutSpec.sampleRate * _audioOutSpec.bytesPerSampleFrame;
+        double buffered = _aRing->available() * 1.0 / bytesPerSec + _aDeviceLatency / 1000000.0;
+        _aTime = _aRingEndTime - buffered * _speed;
+        publishAudioAnchor(_aTime);
+    }
+    // 解码线程没来得及填满, 不够的部分是静音
+    if (filled < len && !_aPktQueue->isEmpty()) {
+        _aUnderruns++;
+        TRACE_INSTANT("underrun", _aTime);
+    }
+    _stageTimes[StageAudioFill].record(av_gettime_relative() - fillStart);
+}
+
+void VideoPlayer::pumpAudio() {
+    TRACE_THREAD("audio decode");
+    while (true) {
+        // 暂停时无界面模式挂起等待, 播放、停止时会被唤醒; 正常播放接着把环形缓冲填满, 恢复播放时马上有声音
+        _stateMutex->lock();
+        while (_sink && _state == Paused) {
+            _stateMutex->wait();
+        }
+        _stateMutex->unlock();
 
         if (_state == Stopped) {
-            // 标记音频资源可以释放
-            _aCanFree = true;
+            setCanFree(_aCanFree);
             break;
         }
-        // 说明当面PCM数据已经全部拷贝到SDL缓冲区, 需要重新获取数据
-        if (_aSwrOutFrameIdx >= _aSwrOutFrameSize) {
-            // 需要解码下一个pkt包, 获取新的解码数据
-            _aSwrOutFrameSize = decoderAudio();
-//            qDebug() << _aSwrOutFrameSize;
-            // 将记录输出PCM填充了多少数据的索引归零
-            _aSwrOutFrameIdx = 0;
-            // 处理重采样数据不成功的
-            if (_aSwrOutFrameSize <= 0) {
-                // 重采样数据不成功的话, 做假静音数据处理
-                // 不能将整SDL缓冲区填充静音数据, 因为缓冲区全放静音数据, 可能会导致播放出来有一段没声音.
-                // 而一个frame重采不成功, 我们用一小段(1024)静音数据当作重采样数据令SDL继续工作, 这样就算有静音耳朵也感觉不出来
-                _aSwrOutFrameSize = 1024;
-                memset(_aSwrOutFrame->data[0], 0, _aSwrOutFrameSize);
+
+        // 上一段PCM还没全部写入环形缓冲
+        if (!_sink && _aSwrOutFrameIdx < _aSwrOutFrameSize) {
+            // 先取清空次数再检查seek: 检查之后seek的清空, 会让这次写入被环形缓冲丢弃
+            int ringSerial = _aRing->serial();
+            if (_aChunkSerial != _aSeekSerial) {
+                // seek了, 还没写完的是seek之前的声音, 丢掉
+                _aSwrOutFrameIdx = _aSwrOutFrameSize;
+                continue;
+            }
+            int written = _aRing->write(_aOutData + _aSwrOutFrameIdx,
+                                        _aSwrOutFrameSize - _aSwrOutFrameIdx,
+                                        ringSerial);
+            _aSwrOutFrameIdx += written;
+            // 写入末尾的时间戳, SDL回调用来算时钟
+            int bytesPerSec = _audioOutSpec.sampleRate * _audioOutSpec.bytesPerSampleFrame;
+            _aRingEndTime = _aChunkTime + _aSwrOutFrameIdx * 1.0 / bytesPerSec * _aChunkSpeed;
+            if (_aSwrOutFrameIdx < _aSwrOutFrameSize) {
+                // 环形缓冲满了(或者seek后SDL回调还没清空), 等SDL回调取走一些时唤醒; 暂停时回调不取数据, 等到恢复播放再唤醒
+                _stateMutex->lock();
+                bool paused = _state == Paused;
+                if (paused) {
+                    _stateMutex->wait();
+                }
+                _stateMutex->unlock();
+                if (!paused && _state == Playing) {
+                    _aRing->waitForSpace(AUDIO_RING_WAIT_MS);
+                }
             }
+            continue;
         }
-        // 得出剩余
-        int fillLen = _aSwrOutFrameSize - _aSwrOutFrameIdx;
-        fillLen = std::min(fillLen, len);
-
-        // 音量
-        int volume = _mute ? 0 : (_volume * 1.0 / Max) * SDL_MIX_MAXVOLUME;
-        SDL_MixAudio(stream,
-                     _aSwrOutFrame->data[0] + _aSwrOutFrameIdx,
-                     fillLen,
-                     volume);
-        // 减去已填充的长度
-        len-=fillLen;
-        // 同时缓冲区移动指针
-        stream+=fillLen;
-        // 记录重采样输出data[0]填充多少SDL数据的索引, 也就说下次从哪里开始读取PCM数据到SDL缓冲区
-        _aSwrOutFrameIdx+=fillLen;
 
+        // 没有包挂起等待读文件线程放入, 不空转(切换文件取解码器缓存的帧时不需要包)
+        if (!_aSwitchDraining && _aPktQueue->isEmpty()) {
+            _aPktQueue->waitForData();
+            continue;
+        }
+
+        int64_t decodeStart = av_gettime_relative();
+        int serial = _aSeekSerial;
+        int size = decoderAudio();
+        if (size <= 0) continue;
+        int64_t outputStart = av_gettime_relative();
+        int samples = size / _audioOutSpec.bytesPerSampleFrame;
+        _throughput.audioDecodeTime += outputStart - decodeStart;
+        _throughput.audioDecodeSamples += samples;
+
+        if (!_sink) {
+            // 变速后下一轮写入环形缓冲
+            _aSwrOutFrameSize = stretchAudio(size, serial);
+            _aSwrOutFrameIdx = 0;
+            _aChunkSerial = serial;
+            continue;
+        }
+
+        // 无界面模式没有播放时钟, 解码到哪就是哪
+        _aTime = _aDecodeTime;
+        _sink->writeAudio(_aOutData, size, _aTime);
+        _throughput.audioOutputTime += av_gettime_relative() - outputStart;
+        _throughput.audioOutputSamples += samples;
     }
 }
 
+int VideoPlayer::stretchAudio(int size, int serial) {
+    int bytesPerSec = _audioOutSpec.sampleRate * _audioOutSpec.bytesPerSampleFrame;
+    double speed = _speed;
+    // seek之后、回到1倍速时清掉变速缓存的声音
+    if (serial != _aStretchSerial || (speed == 1.0 && _aStretching)) {
+        _aStretch->reset();
+        _aStretchSerial = serial;
+    }
+    _aStretching = speed != 1.0;
+    _aChunkSpeed = speed;
+    if (!_aStretching) {
+        _aChunkTime = _aDecodeTime;
+        return size;
+    }
+
+    double inDuration = size * 1.0 / bytesPerSec;
+    size = _aStretch->process(_aOutData, size, speed, &_aOutData);
+    // 变速缓存着一部分输入, 输出末尾的时间戳是放入的末尾往前推还没输出的时长
+    _aChunkTime = _aDecodeTime + inDuration - _aStretch->pending() - size * 1.0 / bytesPerSec * speed;
+    return size;
+}
+
 int VideoPlayer::decoderAudio() {
-    _aMutex->lock();
-
-    // 当木有列表没有音频包
-    // 为什么用while?因为线程等待时,有可能被系统假唤醒.
-//    while (_aPktList->empty()) {
-//        // 线程阻塞等待, 直到有新加的音频包信号
-//        _aMutex->wait();
-//    }
-    if (_aPktList->empty()) {
-        _aMutex->unlock();
+    int ret;
+    // 切换文件前取出上一个文件解码器缓存的帧, 每次取一帧, 取完再换下一个文件的解码器, 中间不插入静音
+    if (_aSwitchDraining) {
+        ret = avcodec_receive_frame(_aDecodeCxt, _aSwrInFrame);
+        if (ret >= 0) {
+            // 取的过程中seek了, 剩下的是seek之前的声音, 丢掉
+            if (_aSwitchDrainSerial != _aSeekSerial) return 0;
+            return convertAudioFrame();
+        }
+        // 取完了(AVERROR_EOF)或者出错, 都切换; 多出来的切换包没有切换, 解码器要恢复到能接着送包的状态
+        _aSwitchDraining = false;
+        if (!switchAudioItem()) {
+            avcodec_flush_buffers(_aDecodeCxt);
+        }
+        return 0;
+    }
+
+    // 队列没有音频包直接返回, 由音频解码线程等待
+    AVPacket pkt;
+    if (!_aPktQueue->pop(pkt)) {
+        return 0;
+    }
+    // 播放列表切换到下一个文件, 先送空包让解码器进入取出缓存帧的状态
+    if (isSwitchPkt(pkt)) {
+        avcodec_send_packet(_aDecodeCxt, nullptr);
+        _aSwitchDraining = true;
+        _aSwitchDrainSerial = _aSeekSerial;
         return 0;
     }
 
-    AVPacket pkt = _aPktList->front();
-    _aPktList->pop_front();
-    _aMutex->unlock();
     // 音频pkt包石见穿是用dts属性
-    // 记录音频播放到的时间戳
+    // 记录音频解码到的时间戳
     if (pkt.dts != AV_NOPTS_VALUE) {
         // dts还原成秒需要乘以一个单位time_base
-        _aTime = av_q2d(_aStream->time_base) * pkt.dts;
+        _aDecodeTime = av_q2d(_aStream->time_base) * pkt.dts;
         emit timeChanged(this);
     }
 
     // 发现音频的时间早于_aSeekTime直接丢弃.
     if (_aSeekTime >= 0) {
-        if (_aTime < _aSeekTime) {
+        if (_aDecodeTime < _aSeekTime) {
             return 0;
         }else {
             _aSeekTime = -1;
@@ -185,7 +398,7 @@ int VideoPlayer::decoderAudio() {
     }
 
     // 发送数据到解码器
-    int ret = avcodec_send_packet(_aDecodeCxt, &pkt);
+    ret = avcodec_send_packet(_aDecodeCxt, &pkt);
     // 释放pkt
     av_packet_unref(&pkt);
     RET(avcodec_send_packet);
@@ -201,6 +414,31 @@ int VideoPlayer::decoderAudio() {
         return 0;
     }else RET(avcodec_receive_frame);
 
+    return convertAudioFrame();
+}
+
+int VideoPlayer::convertAudioFrame() {
+    int ret;
+    // 采样率不变, 专用转换
+    if (_aConvert) {
+        if (_aSwrInFrame->nb_samples > _aSwrOutSamples) {
+            ret = allocAudioOutBuffer(_aSwrInFrame->nb_samples);
+            RET(allocAudioOutBuffer);
+        }
+        _aConvert((const uint8_t * const *)_aSwrInFrame->extended_data,
+                  _aSwrOutFrame->data[0],
+                  _aSwrInFrame->nb_samples,
+                  _audioOutSpec.chs);
+        _aOutData = _aSwrOutFrame->data[0];
+        return _aSwrInFrame->nb_samples * _audioOutSpec.bytesPerSampleFrame;
+    }
+
+    // 不需要重采样, 解码出来的数据直接输出, 下一次解码前一直有效
+    if (!_aSwrCxt) {
+        _aOutData = _aSwrInFrame->data[0];
+        return _aSwrInFrame->nb_samples * _audioOutSpec.bytesPerSampleFrame;
+    }
+
     // 重采样输出的样本数
     int aSwrOutSamples = av_rescale_rnd(_audioOutSpec.sampleRate,
                                         _aSwrInFrame->nb_samples,
@@ -216,29 +454,44 @@ int VideoPlayer::decoderAudio() {
                       _aSwrInFrame->nb_samples);
     RET(swr_convert);
 
+    _aOutData = _aSwrOutFrame->data[0];
     return ret * _audioOutSpec.bytesPerSampleFrame;
 }
 
 void VideoPlayer::addAudioPkt(AVPacket &pkt) {
-    _aMutex->lock();
-    _aPktList->push_back(pkt);
-    _aMutex->signal();
-    _aMutex->unlock();
+    // 槽位用完了挂起等待空位(切换播放列表时会一次放入多个预读的包)
+    while (!_aPktQueue->push(pkt)) {
+        if (_state == Stopped) {
+            av_packet_unref(&pkt);
+            return;
+        }
+        _aPktQueue->waitForSpace();
+    }
 }
 
 void VideoPlayer::clearAudioList() {
-    _aMutex->lock();
-    for(AVPacket &pkt : *_aPktList) {
-        av_packet_unref(&pkt);
+    _aPktQueue->clear();
+    // 环形缓冲里还没播放的声音也要清掉
+    if (_aRing) {
+        _aRing->clear();
     }
-    _aPktList->clear();
-    _aMutex->unlock();
 }
 
 void VideoPlayer::freeAudio() {
+    // 先关闭音频设备, SDL_CloseAudioDevice会等正在执行的回调结束再返回, 之后释放音频资源才安全
+    if (_aDevice) {
+        SDL_PauseAudioDevice(_aDevice, 1);
+        SDL_CloseAudioDevice(_aDevice);
+        _aDevice = 0;
+    }
 
     clearAudioList();
+    delete _aRing;
+    _aRing = nullptr;
+    _aStretch->reset();
+    _aStretching = false;
     swr_free(&_aSwrCxt);
+    _aConvert = nullptr;
     av_frame_free(&_aSwrInFrame);
     if (_aSwrOutFrame) {
         av_freep(&_aSwrOutFrame->data[0]);
@@ -248,13 +501,16 @@ void VideoPlayer::freeAudio() {
 
     _aSwrOutFrameSize = 0;
     _aSwrOutFrameIdx = 0;
+    _aSwrOutSamples = 0;
+    _aOutData = nullptr;
     _aTime = 0;
+    resetAudioClock();
+    _aDeviceLatency = 0;
+    _aDecodeTime = 0;
+    _aRingEndTime = 0;
     _aSeekTime = -1;
+    _aSwitchDraining = false;
     _aStream = nullptr;
     _hasAudio = false;
     _aCanFree = false;
-
-    // 暂停播放
-    SDL_PauseAudio(1);
-    SDL_CloseAudio();
 }
@@ -27,3 +27,6 @@ void CondMutex::broadcast() {
 void CondMutex::wait() {
     SDL_CondWait(_cond, _mutex);
 }
+bool CondMutex::waitTimeout(Uint32 ms) {
+    return SDL_CondWaitTimeout(_cond, _mutex, ms) == 0;
+}
@@ -14,6 +14,8 @@ public:
     void signal();
     void broadcast();
     void wait();
+    /** 最多等待ms毫秒, 超时返回false*/
+    bool waitTimeout(Uint32 ms);
 private:
     SDL_cond *_cond = nullptr;
     SDL_mutex *_mutex = nullptr;
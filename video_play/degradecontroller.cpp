@@ -0,0 +1,74 @@
+#include "degradecontroller.h"
+#include <QDebug>
+extern "C" {
+#include <libavutil/time.h>
+}
+
+// 统计周期 单位是微妙, 按时间而不是帧数, 只解码关键帧时一秒也只有零星几帧
+#define DEGRADE_WINDOW (1 * 1000 * 1000)
+// 迟到超过多少秒算迟到, 要比音频时钟的更新间隔(一个音频包)大
+#define DEGRADE_LATE_THRESHOLD 0.05
+// 一个周期里迟到的帧超过这个比例就降一级
+#define DEGRADE_LATE_RATIO 0.2
+// 有余量的帧超过这个比例才算这个周期解码有余量
+#define DEGRADE_HEADROOM_RATIO 0.9
+// 连续几个周期准时并且有余量才升一级, 比降级慢, 避免来回抖动
+#define DEGRADE_RECOVER_WINDOWS 4
+
+DegradeController::DegradeController(int maxLevel)
+    : _maxLevel(maxLevel)
+{
+
+}
+
+void DegradeController::update(double lateness, bool dropped, bool headroom) {
+    int64_t now = av_gettime_relative();
+    if (_windowStart < 0) {
+        _windowStart = now;
+    }
+    _frames++;
+    if (dropped || lateness > DEGRADE_LATE_THRESHOLD) {
+        _lateFrames++;
+    }
+    if (headroom) {
+        _headroomFrames++;
+    }
+    if (now - _windowStart < DEGRADE_WINDOW) return;
+
+    int level = _level;
+    if (_lateFrames > _frames * DEGRADE_LATE_RATIO) {
+        // 跟不上了降一级
+        _goodWindows = 0;
+        if (level < _maxLevel) {
+            _level = ++level;
+            qDebug() << "video degrade level" << level << "late" << _lateFrames << "/" << _frames;
+        }
+    }else if (_lateFrames == 0 && _headroomFrames >= _frames * DEGRADE_HEADROOM_RATIO) {
+        // 又有余量了升一级
+        if (++_goodWindows >= DEGRADE_RECOVER_WINDOWS && level > 0) {
+            _goodWindows = 0;
+            _level = --level;
+            qDebug() << "video degrade level" << level;
+        }
+    }else {
+        _goodWindows = 0;
+    }
+
+    _windowStart = now;
+    _frames = 0;
+    _lateFrames = 0;
+    _headroomFrames = 0;
+}
+
+int DegradeController::level() {
+    return _level;
+}
+
+void DegradeController::reset() {
+    _level = 0;
+    _windowStart = -1;
+    _frames = 0;
+    _lateFrames = 0;
+    _headroomFrames = 0;
+    _goodWindows = 0;
+}
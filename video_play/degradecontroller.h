@@ -0,0 +1,44 @@
+#ifndef DEGRADECONTROLLER_H
+#define DEGRADECONTROLLER_H
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * 视频降级控制
+ * 显示线程每显示(或丢弃)一帧报告一次迟到多少、解码线程有没有提前解码好的画面, 每隔一段时间统计一次:
+ * 迟到的帧多了降一级, 连续几段时间都准时并且解码有余量再升一级.
+ * 解码线程按当前级别调整缩放算法、环路滤波、跳帧.
+ */
+class DegradeController
+{
+public:
+    /** maxLevel: 最多降到第几级*/
+    DegradeController(int maxLevel);
+
+    /**
+     * 报告一帧(显示线程调用)
+     * lateness: 迟到多少秒, 负数说明提前
+     * dropped: 是否来不及显示被丢弃
+     * headroom: 显示时队列里是否还有解码好的下一帧
+     */
+    void update(double lateness, bool dropped, bool headroom);
+    /** 当前级别, 0是不降级(任意线程调用)*/
+    int level();
+    /** 回到不降级, 清空统计(打开新文件时调用)*/
+    void reset();
+
+private:
+    int _maxLevel = 0;
+    std::atomic<int> _level{0};
+    /** 当前统计周期开始的时刻 单位是微妙*/
+    int64_t _windowStart = -1;
+    /** 当前统计周期的帧数、迟到帧数、有余量的帧数*/
+    int _frames = 0;
+    int _lateFrames = 0;
+    int _headroomFrames = 0;
+    /** 连续几个统计周期都准时并且有余量*/
+    int _goodWindows = 0;
+};
+
+#endif // DEGRADECONTROLLER_H
@@ -0,0 +1,60 @@
+#include "framemailbox.h"
+
+// 中间位置的下标里表示有新画面的标记位, 低两位是下标
+#define MAILBOX_NEW 4
+#define MAILBOX_INDEX 3
+
+FrameMailbox::~FrameMailbox() {
+    clear();
+    for (FrameQueue::Frame &slot : _slots) {
+        av_buffer_unref(&slot.buf);
+    }
+}
+
+bool FrameMailbox::post(FrameQueue::Frame &frame) {
+    // 写进自己的位置, 再和中间的位置交换
+    _slots[_back] = frame;
+    frame.buf = nullptr;
+    int old = _middle.exchange(_back | MAILBOX_NEW, std::memory_order_acq_rel);
+    _back = old & MAILBOX_INDEX;
+    // 换下来的是界面线程还没来得及取的旧画面, 不再显示
+    if (old & MAILBOX_NEW) {
+        av_buffer_unref(&_slots[_back].buf);
+        _superseded++;
+    }
+    return !_notified.exchange(true, std::memory_order_acq_rel);
+}
+
+bool FrameMailbox::take(FrameQueue::Frame &frame) {
+    // 先清除通知再取, 取之后放入的画面一定会再通知
+    _notified.store(false, std::memory_order_release);
+    if (!(_middle.load(std::memory_order_acquire) & MAILBOX_NEW)) return false;
+    // 把自己读完的位置换到中间, 换出新画面所在的位置
+    int old = _middle.exchange(_front, std::memory_order_acq_rel);
+    _front = old & MAILBOX_INDEX;
+    // 交换前被clear清掉了
+    if (!(old & MAILBOX_NEW)) return false;
+    frame = _slots[_front];
+    _slots[_front].buf = nullptr;
+    return true;
+}
+
+void FrameMailbox::clear() {
+    // 放入方已经停了, 界面线程可能同时在取: 用比较交换去掉新画面标记, 抢到的一方负责释放这一帧
+    int mail = _middle.load(std::memory_order_acquire);
+    while (mail & MAILBOX_NEW) {
+        if (_middle.compare_exchange_weak(mail, mail & MAILBOX_INDEX, std::memory_order_acq_rel)) {
+            av_buffer_unref(&_slots[mail & MAILBOX_INDEX].buf);
+            break;
+        }
+    }
+    _notified = false;
+}
+
+int FrameMailbox::superseded() {
+    return _superseded;
+}
+
+void FrameMailbox::resetSuperseded() {
+    _superseded = 0;
+}
@@ -0,0 +1,43 @@
+#ifndef FRAMEMAILBOX_H
+#define FRAMEMAILBOX_H
+
+#include <atomic>
+#include "framequeue.h"
+
+/**
+ * 显示线程交给界面线程的画面信箱
+ * 只保留最新的一帧, 放入新画面时还没被取走的旧画面直接归还缓冲池, 界面线程卡住时内存也不会增长, 恢复后只画最新的一帧.
+ * 三个预分配的位置轮流使用(三缓冲): 放入方写自己的位置, 取出方读自己的位置, 和中间的位置原子交换下标, 每帧不分配内存.
+ * 通知也是合并的: 界面线程取走之前再放入的画面不会重复通知.
+ */
+class FrameMailbox
+{
+public:
+    ~FrameMailbox();
+
+    /** 放入最新的画面(显示线程调用), buf的引用交给信箱; 返回true说明需要通知界面线程来取*/
+    bool post(FrameQueue::Frame &frame);
+    /** 取出最新的画面(界面线程调用), buf的引用归调用者, 没有新画面返回false*/
+    bool take(FrameQueue::Frame &frame);
+    /** 释放还没取走的画面(停止时调用)*/
+    void clear();
+    /** 没来得及画就被覆盖的画面数*/
+    int superseded();
+    /** 清零覆盖计数*/
+    void resetSuperseded();
+
+private:
+    /** 预分配的三个位置*/
+    FrameQueue::Frame _slots[3] {};
+    /** 中间位置的下标, 加上有没有还没取走的新画面的标记*/
+    std::atomic<int> _middle{1};
+    /** 放入方(显示线程)写的位置*/
+    int _back = 0;
+    /** 取出方(界面线程)读的位置*/
+    int _front = 2;
+    /** 是否已经通知过界面线程还没来取*/
+    std::atomic<bool> _notified{false};
+    std::atomic<int> _superseded{0};
+};
+
+#endif // FRAMEMAILBOX_H
@@ -0,0 +1,113 @@
+#include "framequeue.h"
+
+FrameQueue::FrameQueue(int capacity, int64_t maxBytes)
+    : _capacity(capacity), _maxBytes(maxBytes)
+{
+    // 槽位一次分配好
+    _frames = new Frame[_capacity];
+}
+
+FrameQueue::~FrameQueue() {
+    clear();
+    delete[] _frames;
+}
+
+bool FrameQueue::push(Frame &frame) {
+    _mutex.lock();
+    // seek清空之后才放进来的旧画面, 不再显示
+    if (frame.generation != _generation) {
+        _mutex.unlock();
+        av_buffer_unref(&frame.buf);
+        return true;
+    }
+    if (isFullLocked()) {
+        _mutex.unlock();
+        return false;
+    }
+    _frames[(_head + _count) % _capacity] = frame;
+    _count++;
+    _bytes += frame.size;
+    _mutex.unlock();
+    return true;
+}
+
+bool FrameQueue::peek(Frame &frame, int idx) {
+    _mutex.lock();
+    bool ok = idx < _count;
+    if (ok) {
+        frame = _frames[(_head + idx) % _capacity];
+    }
+    _mutex.unlock();
+    return ok;
+}
+
+bool FrameQueue::pop(Frame &frame) {
+    _mutex.lock();
+    if (_count == 0) {
+        _mutex.unlock();
+        return false;
+    }
+    frame = _frames[_head];
+    _head = (_head + 1) % _capacity;
+    _count--;
+    _bytes -= frame.size;
+    // 唤醒在等待空位的生产者
+    _mutex.broadcast();
+    _mutex.unlock();
+    return true;
+}
+
+void FrameQueue::clear() {
+    _mutex.lock();
+    while (_count > 0) {
+        av_buffer_unref(&_frames[_head].buf);
+        _head = (_head + 1) % _capacity;
+        _count--;
+    }
+    _bytes = 0;
+    _generation++;
+    _mutex.broadcast();
+    _mutex.unlock();
+}
+
+int FrameQueue::generation() {
+    _mutex.lock();
+    int generation = _generation;
+    _mutex.unlock();
+    return generation;
+}
+
+bool FrameQueue::isFull() {
+    _mutex.lock();
+    bool full = isFullLocked();
+    _mutex.unlock();
+    return full;
+}
+
+int FrameQueue::size() {
+    _mutex.lock();
+    int count = _count;
+    _mutex.unlock();
+    return count;
+}
+
+void FrameQueue::waitForSpace() {
+    _mutex.lock();
+    while (isFullLocked() && !_wakeupProducer) {
+        _mutex.wait();
+    }
+    _wakeupProducer = false;
+    _mutex.unlock();
+}
+
+void FrameQueue::wakeup() {
+    _mutex.lock();
+    _wakeupProducer = true;
+    _mutex.broadcast();
+    _mutex.unlock();
+}
+
+bool FrameQueue::isFullLocked() {
+    // 高分辨率时按字节限制, 但至少留两帧, 否则解码没法提前
+    return _count >= _capacity || (_count >= 2 && _bytes >= _maxBytes);
+}
@@ -0,0 +1,85 @@
+#ifndef FRAMEQUEUE_H
+#define FRAMEQUEUE_H
+
+#include "condmutex.h"
+extern "C" {
+#include <libavutil/buffer.h>
+#include <libavutil/pixfmt.h>
+}
+
+/**
+ * 解码并转换好的画面环形队列
+ * 视频解码线程放入(生产者), 显示线程按时间戳取出(消费者), 解码可以提前跑几帧, 吸收GOP里解码耗时的波动.
+ * 队列上限按槽位数和字节数限制, 至少能放两帧.
+ */
+class FrameQueue
+{
+public:
+    // 一帧画面
+    typedef struct {
+        /** 缓冲池里的一个引用*/
+        AVBufferRef *buf;
+        int width;
+        int height;
+        AVPixelFormat pixelFmt;
+        int size;
+        /** 显示时间戳 单位是秒*/
+        double pts;
+        /** 播放列表切换序号, 和音频相同时才做音视频同步*/
+        int serial;
+        /** 放入时队列的清空代数, 和队列当前的不一致说明是清空前解码的旧画面*/
+        int generation;
+        /** 立即显示不等待时钟(seek后的第一帧、快速启动的第一帧), 暂停时也显示*/
+        bool immediate;
+        /** 放入队列的时刻 单位是微妙, 统计在队列里等了多久*/
+        int64_t queuedTime;
+        /** 并行转换的序号, 显示前要等这一帧转换完成, 0是放入时已经转换好了*/
+        int scaleGeneration;
+    } Frame;
+
+    /**
+     * capacity: 槽位数
+     * maxBytes: 最多缓存多少字节的画面
+     */
+    FrameQueue(int capacity, int64_t maxBytes);
+    ~FrameQueue();
+
+    /** 放入画面(生产者调用), buf的引用交给队列, 满了返回false; 清空前解码的旧画面直接释放*/
+    bool push(Frame &frame);
+    /** 查看第idx个画面但不取出, 没有返回false*/
+    bool peek(Frame &frame, int idx = 0);
+    /** 取出画面(消费者调用), buf的引用交给调用者, 队列为空返回false*/
+    bool pop(Frame &frame);
+    /** 释放所有画面, 清空代数加1(seek时调用)*/
+    void clear();
+    /** 当前清空代数*/
+    int generation();
+    /** 槽位或字节数达到上限就算满*/
+    bool isFull();
+    /** 画面个数*/
+    int size();
+    /** 生产者挂起, 直到队列不满或者被wakeup唤醒*/
+    void waitForSpace();
+    /** 唤醒挂起的生产者(停止时调用)*/
+    void wakeup();
+
+private:
+    /** 预分配的槽位*/
+    Frame *_frames = nullptr;
+    int _capacity = 0;
+    int64_t _maxBytes = 0;
+    /** 读位置和画面个数*/
+    int _head = 0;
+    int _count = 0;
+    int64_t _bytes = 0;
+    int _generation = 0;
+    /** 是否被外部唤醒, 在挂起前设置也不会丢失*/
+    bool _wakeupProducer = false;
+    /** 队列锁, 一秒只有几十帧, 直接加锁*/
+    CondMutex _mutex;
+
+    /** 是否满, 调用前要加锁*/
+    bool isFullLocked();
+};
+
+#endif // FRAMEQUEUE_H
@@ -0,0 +1,68 @@
+#include "latencyhistogram.h"
+#include <cmath>
+#include <algorithm>
+
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+void LatencyHistogram::record(int64_t time) {
+    if (time < 0) time = 0;
+    // 桶的序号就是耗时的二进制位数
+    int idx = 0;
+    while (idx < LATENCY_HISTOGRAM_BUCKETS - 1 && (time >> idx)) {
+        idx++;
+    }
+    _buckets[idx].fetch_add(1, std::memory_order_relaxed);
+    _sum.fetch_add(time, std::memory_order_relaxed);
+
+    int64_t max = _max.load(std::memory_order_relaxed);
+    while (time > max && !_max.compare_exchange_weak(max, time, std::memory_order_relaxed)) {
+    }
+}
+
+LatencyHistogram::Summary LatencyHistogram::summary() {
+    // 先取各个桶的快照, 个数按快照算, 分位数不会越界
+    int64_t counts[LATENCY_HISTOGRAM_BUCKETS];
+    int64_t count = 0;
+    for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+        counts[i] = _buckets[i].load(std::memory_order_relaxed);
+        count += counts[i];
+    }
+
+    Summary summary;
+    summary.count = count;
+    summary.max = _max.load(std::memory_order_relaxed);
+    summary.mean = count > 0 ? _sum.load(std::memory_order_relaxed) / count : 0;
+    summary.p50 = percentile(counts, count, 0.5, summary.max);
+    summary.p95 = percentile(counts, count, 0.95, summary.max);
+    summary.p99 = percentile(counts, count, 0.99, summary.max);
+    return summary;
+}
+
+void LatencyHistogram::reset() {
+    for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+        _buckets[i] = 0;
+    }
+    _sum = 0;
+    _max = 0;
+}
+
+int64_t LatencyHistogram::percentile(const int64_t *counts, int64_t count, double p, int64_t max) {
+    if (count <= 0) return 0;
+    int64_t target = std::max<int64_t>(1, (int64_t)std::ceil(count * p));
+    int64_t seen = 0;
+    for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+        if (seen + counts[i] < target) {
+            seen += counts[i];
+            continue;
+        }
+        // 在桶的上下界之间按落在桶里的位置插值
+        int64_t lower = i == 0 ? 0 : (int64_t)1 << (i - 1);
+        int64_t upper = (int64_t)1 << i;
+        int64_t value = lower + (upper - lower) * (target - seen) / counts[i];
+        return std::min(value, max);
+    }
+    return max;
+}
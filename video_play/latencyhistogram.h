@@ -0,0 +1,46 @@
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <atomic>
+#include <cstdint>
+
+// 桶数, 第i个桶存放[2^(i-1), 2^i)微妙的耗时, 最后一个桶存放更长的
+#define LATENCY_HISTOGRAM_BUCKETS 32
+
+/**
+ * 耗时直方图
+ * 按2的幂分桶, 记录只是几次原子加, 可以在播放的热路径里调用, 多个线程同时记录也安全.
+ * 分位数在桶内线性插值估算, 误差不超过一个桶宽.
+ */
+class LatencyHistogram
+{
+public:
+    // 统计结果, 时间单位是微妙
+    typedef struct {
+        int64_t count;
+        int64_t mean;
+        int64_t p50;
+        int64_t p95;
+        int64_t p99;
+        int64_t max;
+    } Summary;
+
+    LatencyHistogram();
+
+    /** 记录一次耗时 单位是微妙*/
+    void record(int64_t time);
+    /** 统计结果, 记录的同时读取只是近似值*/
+    Summary summary();
+    /** 清空*/
+    void reset();
+
+private:
+    std::atomic<int64_t> _buckets[LATENCY_HISTOGRAM_BUCKETS];
+    std::atomic<int64_t> _sum{0};
+    std::atomic<int64_t> _max{0};
+
+    /** 第p(0~1)分位的耗时, counts是各个桶的快照*/
+    int64_t percentile(const int64_t *counts, int64_t count, double p, int64_t max);
+};
+
+#endif // LATENCYHISTOGRAM_H
@@ -1,9 +1,58 @@
 #include "mainwindow.h"
+#include "videoplayer.h"
+#include "mediasink.h"
 
 #include <QApplication>
+#include <QCoreApplication>
+#include <cstring>
+
+/**
+ * 无界面模式: video_play --headless 文件 [输出文件前缀]
+ * 不需要显示器和声卡, 全速解码后打印各阶段吞吐量; 有输出文件前缀时画面写入前缀.rgb, PCM写入前缀.pcm
+ * 播放失败返回1, 批量检查文件时按返回值判断
+ */
+static int runHeadless(int argc, char *argv[]) {
+    QCoreApplication a(argc, argv);
+
+    MediaSink *sink = nullptr;
+    if (argc >= 4) {
+        QByteArray videoPath = QByteArray(argv[3]) + ".rgb";
+        QByteArray audioPath = QByteArray(argv[3]) + ".pcm";
+        RawFileSink *rawSink = new RawFileSink(videoPath.constData(), audioPath.constData());
+        if (!rawSink->isOpen()) {
+            delete rawSink;
+            return 1;
+        }
+        sink = rawSink;
+    }else {
+        sink = new NullSink();
+    }
+
+    int result = 0;
+    VideoPlayer *player = new VideoPlayer();
+    player->setHeadless(sink);
+    QObject::connect(player, &VideoPlayer::videoPlayFalied, [&result](VideoPlayer *) {
+        result = 1;
+    });
+    // 在播放器的线程发出, 资源都释放后再回到主线程退出
+    QObject::connect(player, &VideoPlayer::headlessFinished, &a, [&a](VideoPlayer *) {
+        a.quit();
+    }, Qt::QueuedConnection);
+    player->setFilename(QString::fromLocal8Bit(argv[2]));
+    player->play();
+    a.exec();
+
+    delete player;
+    delete sink;
+    return result;
+}
 
 int main(int argc, char *argv[])
 {
+    if (argc >= 3 && strcmp(argv[1], "--headless") == 0) {
+        return runHeadless(argc, argv);
+    }
+
     QApplication a(argc, argv);
     MainWindow w;
     w.show();
@@ -3,16 +3,17 @@
 #include <QFileDialog>
 #include <QDebug>
 #include <QMessageBox>
+#include <QShortcut>
+#include <QDir>
 
+// 进度条悬停预览缩略图的宽度
+#define THUMBNAIL_WIDTH 160
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
 {
     ui->setupUi(this);
-    // 注册信号参数类型
-    qRegisterMetaType<VideoPlayer::VideoSwsSpec>("VideoSwsSpec&");
-
     _player = new VideoPlayer();
     connect(_player, &VideoPlayer::videoStatcChanged,
             this, &MainWindow::onPlayerVideoStatc);
@@ -23,13 +24,33 @@ MainWindow::MainWindow(QWidget *parent)
     connect(_player, &VideoPlayer::timeChanged,
             this, &MainWindow::onPlayerTimeChanged);
 
-    connect(_player,&VideoPlayer::videoPlayFrameDecoded,
-            ui->videoWidget, &VideoWidget::frameDecoded);
+    connect(_player,&VideoPlayer::videoFrameAvailable,
+            ui->videoWidget, &VideoWidget::frameAvailable);
     connect(_player,&VideoPlayer::videoStatcChanged,
             ui->videoWidget, &VideoWidget::onPlayerVideoStatc);
 
     connect(ui->timeSlider, &VideoSlider::clicked,
             this, &MainWindow::onPlayerTimeSliderClicked);
+    connect(ui->timeSlider, &VideoSlider::dragged,
+            this, &MainWindow::onPlayerTimeSliderDragged);
+    connect(ui->timeSlider, &VideoSlider::released,
+            this, &MainWindow::onPlayerTimeSliderReleased);
+
+    // Ctrl+I 显示\隐藏播放统计
+    QShortcut *statsShortcut = new QShortcut(QKeySequence("Ctrl+I"), this);
+    connect(statsShortcut, &QShortcut::activated, this, [this]() {
+        ui->videoWidget->setStatsOverlay(!ui->videoWidget->isStatsOverlay());
+    });
+
+    // Ctrl+T 把追踪事件写到临时目录, 用chrome://tracing或者Perfetto打开
+    QShortcut *traceShortcut = new QShortcut(QKeySequence("Ctrl+T"), this);
+    connect(traceShortcut, &QShortcut::activated, this, [this]() {
+        _player->flushTrace(QDir::tempPath() + "/video_play_trace.json");
+    });
+
+    // 缩略图在后台生成, 进度条悬停时显示
+    _thumbnails = new ThumbnailStrip(this);
+    ui->timeSlider->setThumbnails(_thumbnails);
 
     // 设置音量范围
     ui->volumeSlider->setRange(VideoPlayer::Volume::Min,
@@ -50,25 +71,16 @@ MainWindow::~MainWindow()
 
 void MainWindow::on_openFileBtn_clicked()
 {
-    QString filename = QFileDialog::getOpenFileName(nullptr,
-                                                    "选择多媒体文件",
-                                                    "/Users/iso9007/Desktop/ffmpeg/testMusic",
-                                                    "多媒体文件 (*.mp4 *.avi *.mkv *.aac *.mp3)");
-    qDebug() << filename;
-    if (filename.isEmpty()) return;
-
-    _player->setFilename(filename);
-    _player->play();
-    // 这是多选
-    /*
+    // 多选的文件作为播放列表按顺序无缝播放
     QStringList filenames = QFileDialog::getOpenFileNames(nullptr,
                                                           "选择多媒体文件",
                                                           "/Users/iso9007/Desktop/ffmpeg/testMusic",
-                                                          "视频文件 (*.mp4 *.avi *.mkv);;音频文件 (*.aac *.mp3)");
-    foreach(QString filename, filenames) {
-        qDebug() << filename;
-    }
-    */
+                                                          "多媒体文件 (*.mp4 *.avi *.mkv *.aac *.mp3)");
+    qDebug() << filenames;
+    if (filenames.isEmpty()) return;
+
+    _player->setPlaylist(filenames);
+    _player->play();
 }
 void MainWindow::onPlayerVideoStatc(VideoPlayer *player) {
     VideoPlayer::State statc = player->getStatc();
@@ -87,6 +99,8 @@ void MainWindow::onPlayerVideoStatc(VideoPlayer *player) {
 
         ui->timeSlider->setValue(0);
         ui->durationTime->setText(getTimeText(0));
+        // 停止生成缩略图
+        _thumbnails->cancel();
         // 显示打开文件界面
         ui->playWidget->setCurrentWidget(ui->openFilePage);
     }else {
@@ -100,6 +114,8 @@ void MainWindow::onPlayerVideoStatc(VideoPlayer *player) {
     }
 }
 void MainWindow::onPlayerTimeChanged(VideoPlayer *player){
+    // 拖动中不跟着播放时间跳
+    if (ui->timeSlider->isSliderDown()) return;
     int second = player->getTime();
     ui->timeSlider->setValue(second);
 }
@@ -112,11 +128,20 @@ void MainWindow::onPlayerVideoInitFinished(VideoPlayer *player) {
     ui->timeSlider->setRange(0, second);
     // 设置持续时间
     ui->durationTime->setText(getTimeText(second));
+    // 开始生成进度条预览缩略图(播放列表切换文件时也会走这里)
+    _thumbnails->load(player->getFilename(), second, THUMBNAIL_WIDTH);
 
 }
 void MainWindow::onPlayerTimeSliderClicked(VideoSlider *slider) {
     _player->setTime(slider->value());
 }
+void MainWindow::onPlayerTimeSliderDragged(VideoSlider *slider) {
+    // 拖动中只显示关键帧, 跟得上鼠标
+    _player->scrub(slider->value());
+}
+void MainWindow::onPlayerTimeSliderReleased(VideoSlider *slider) {
+    _player->endScrub(slider->value());
+}
 void MainWindow::on_timeSlider_valueChanged(int value)
 {
     ui->currentTime->setText(getTimeText(value));
@@ -43,9 +43,15 @@ private slots:
 
     void onPlayerTimeSliderClicked(VideoSlider *slider);
 
+    void onPlayerTimeSliderDragged(VideoSlider *slider);
+
+    void onPlayerTimeSliderReleased(VideoSlider *slider);
+
 private:
     Ui::MainWindow *ui;
     VideoPlayer *_player = nullptr;
+    /** 进度条悬停预览的缩略图*/
+    ThumbnailStrip *_thumbnails = nullptr;
     QString getTimeText(int duration);
 };
 #endif // MAINWINDOW_H
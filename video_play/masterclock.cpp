@@ -0,0 +1,103 @@
+#include "masterclock.h"
+#include <chrono>
+#include <thread>
+
+MasterClock::MasterClock()
+{
+
+}
+
+int64_t MasterClock::now() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void MasterClock::sleepUntil(int64_t deadline) {
+    // 按绝对时刻睡眠, 被提前唤醒或者调度延迟都不会把误差带到下一帧
+    std::this_thread::sleep_until(std::chrono::steady_clock::time_point(
+                                      std::chrono::microseconds(deadline)));
+}
+
+void MasterClock::set(double time) {
+    _mutex.lock();
+    _base = time;
+    _start = now();
+    _set = true;
+    _mutex.unlock();
+}
+
+void MasterClock::setAnchor(double time, int64_t start) {
+    _mutex.lock();
+    // 暂停、变速时在更晚的时刻重新设置过锚点, 旧锚点不能把时钟拉回去
+    if (!_set || start >= _start) {
+        _base = time;
+        _start = start;
+        _set = true;
+    }
+    _mutex.unlock();
+}
+
+void MasterClock::reset() {
+    _mutex.lock();
+    _set = false;
+    _mutex.unlock();
+}
+
+bool MasterClock::isSet() {
+    _mutex.lock();
+    bool set = _set;
+    _mutex.unlock();
+    return set;
+}
+
+double MasterClock::time() {
+    _mutex.lock();
+    double time = timeLocked(now());
+    _mutex.unlock();
+    return time;
+}
+
+void MasterClock::setPaused(bool paused) {
+    _mutex.lock();
+    if (paused != _paused) {
+        // 暂停和恢复都在当前时间重新设置锚点
+        int64_t t = now();
+        _base = timeLocked(t);
+        _start = t;
+        _paused = paused;
+    }
+    _mutex.unlock();
+}
+
+void MasterClock::setRate(double rate) {
+    if (rate <= 0) return;
+    _mutex.lock();
+    int64_t t = now();
+    _base = timeLocked(t);
+    _start = t;
+    _rate = rate;
+    _mutex.unlock();
+}
+
+double MasterClock::getRate() {
+    _mutex.lock();
+    double rate = _rate;
+    _mutex.unlock();
+    return rate;
+}
+
+int64_t MasterClock::deadline(double time) {
+    _mutex.lock();
+    int64_t deadline = -1;
+    if (_set && !_paused) {
+        deadline = _start + (int64_t)((time - _base) / _rate * 1000000);
+    }
+    _mutex.unlock();
+    return deadline;
+}
+
+double MasterClock::timeLocked(int64_t now) {
+    if (!_set) return 0;
+    if (_paused) return _base;
+    return _base + (now - _start) / 1000000.0 * _rate;
+}
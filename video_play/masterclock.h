@@ -0,0 +1,53 @@
+#ifndef MASTERCLOCK_H
+#define MASTERCLOCK_H
+
+#include <cstdint>
+#include "condmutex.h"
+
+/**
+ * 外部主时钟
+ * 用单调时钟推算播放时间, 没有音频的文件(或者设置了外部时钟)画面按它显示.
+ * 时间 = 锚点时间 + (现在 - 锚点时刻) * 速度, 暂停时停在暂停的时间, seek时重新设置锚点.
+ */
+class MasterClock
+{
+public:
+    MasterClock();
+
+    /** 单调时钟的现在 单位是微妙*/
+    static int64_t now();
+    /** 睡到单调时钟的deadline时刻(绝对时刻, 不累积误差), 精度远小于1毫秒*/
+    static void sleepUntil(int64_t deadline);
+
+    /** 把当前播放时间设为time秒(显示seek后或者新文件的第一帧时调用)*/
+    void set(double time);
+    /** 把单调时钟start时刻的播放时间设为time秒(锚点在别的线程测得), 比当前锚点旧就不用*/
+    void setAnchor(double time, int64_t start);
+    /** 清除锚点, 下一帧重新设置(seek、停止时调用)*/
+    void reset();
+    /** 是否设置过锚点*/
+    bool isSet();
+    /** 当前播放时间 单位是秒*/
+    double time();
+    /** 暂停\恢复, 恢复后从暂停的时间接着走*/
+    void setPaused(bool paused);
+    /** 设置速度, 从当前时间开始按新的速度走*/
+    void setRate(double rate);
+    double getRate();
+    /** 播放时间到达time秒时单调时钟的时刻 单位是微妙, 暂停或者没设置锚点返回-1*/
+    int64_t deadline(double time);
+
+private:
+    /** 锚点: 播放时间和对应的单调时钟时刻*/
+    double _base = 0;
+    int64_t _start = 0;
+    bool _set = false;
+    bool _paused = false;
+    double _rate = 1.0;
+    CondMutex _mutex;
+
+    /** 当前播放时间, 调用前要加锁*/
+    double timeLocked(int64_t now);
+};
+
+#endif // MASTERCLOCK_H
@@ -0,0 +1,22 @@
+#include "mediacache.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+
+QString MediaCache::filePath(const char *filename, const QString &dir, const QString &suffix) {
+    // 文件路径+大小+修改时间作为文件标识
+    QFileInfo info(QString::fromUtf8(filename));
+    QString identity = QString("%1|%2|%3")
+            .arg(info.absoluteFilePath())
+            .arg(info.size())
+            .arg(info.lastModified().toMSecsSinceEpoch());
+    QString hash = QCryptographicHash::hash(identity.toUtf8(), QCryptographicHash::Md5).toHex();
+    QString root = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    return QDir(root + "/" + dir).filePath(hash + suffix);
+}
+
+bool MediaCache::makeDir(const QString &cachePath) {
+    return QDir().mkpath(QFileInfo(cachePath).absolutePath());
+}
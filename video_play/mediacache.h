@@ -0,0 +1,23 @@
+#ifndef MEDIACACHE_H
+#define MEDIACACHE_H
+
+#include <QString>
+
+/**
+ * 媒体文件缓存目录
+ * 关键帧索引、探测结果等按文件标识保存在缓存目录下
+ */
+class MediaCache
+{
+public:
+    /**
+     * 根据文件路径、大小、修改时间生成缓存文件路径, 文件被替换后缓存自动失效
+     * dir: 缓存目录下的子目录
+     * suffix: 缓存文件后缀
+     */
+    static QString filePath(const char *filename, const QString &dir, const QString &suffix);
+    /** 创建缓存文件所在的目录*/
+    static bool makeDir(const QString &cachePath);
+};
+
+#endif // MEDIACACHE_H
@@ -0,0 +1,70 @@
+#include "mediasink.h"
+#include <QDebug>
+
+#pragma mark - NullSink
+void NullSink::writeVideo(const uint8_t *, int, int, int, AVPixelFormat, double) {
+
+}
+
+void NullSink::writeAudio(const uint8_t *, int, double) {
+
+}
+
+#pragma mark - RawFileSink
+RawFileSink::RawFileSink(const char *videoPath, const char *audioPath) {
+    if (videoPath && videoPath[0]) {
+        _videoFile = fopen(videoPath, "wb");
+        if (!_videoFile) {
+            qDebug() << "raw video file open error:" << videoPath;
+            _open = false;
+        }
+    }
+    if (audioPath && audioPath[0]) {
+        _audioFile = fopen(audioPath, "wb");
+        if (!_audioFile) {
+            qDebug() << "raw audio file open error:" << audioPath;
+            _open = false;
+        }
+    }
+}
+
+RawFileSink::~RawFileSink() {
+    if (_videoFile) fclose(_videoFile);
+    if (_audioFile) fclose(_audioFile);
+}
+
+bool RawFileSink::isOpen() {
+    return _open;
+}
+
+void RawFileSink::writeVideo(const uint8_t *data, int size, int, int, AVPixelFormat, double) {
+    if (_videoFile) {
+        fwrite(data, 1, size, _videoFile);
+    }
+}
+
+void RawFileSink::writeAudio(const uint8_t *data, int size, double) {
+    if (_audioFile) {
+        fwrite(data, 1, size, _audioFile);
+    }
+}
+
+#pragma mark - CallbackSink
+CallbackSink::CallbackSink(VideoCallback video, AudioCallback audio)
+    : _video(video), _audio(audio)
+{
+
+}
+
+void CallbackSink::writeVideo(const uint8_t *data, int size,
+                              int width, int height, AVPixelFormat pixelFmt, double pts) {
+    if (_video) {
+        _video(data, size, width, height, pixelFmt, pts);
+    }
+}
+
+void CallbackSink::writeAudio(const uint8_t *data, int size, double pts) {
+    if (_audio) {
+        _audio(data, size, pts);
+    }
+}
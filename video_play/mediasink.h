@@ -0,0 +1,79 @@
+#ifndef MEDIASINK_H
+#define MEDIASINK_H
+
+#include <cstdio>
+#include <functional>
+extern "C" {
+#include <libavutil/pixfmt.h>
+}
+
+/**
+ * 无界面模式的输出
+ * 画面和PCM不交给界面和声卡, 直接交给输出, 播放器不按时钟等待, 全速解码.
+ * writeVideo在视频显示线程回调, writeAudio在音频解码线程回调, 两个会同时调用.
+ */
+class MediaSink
+{
+public:
+    virtual ~MediaSink() {}
+    /** 一帧画面, data回调返回后就归还缓冲池, pts单位是秒*/
+    virtual void writeVideo(const uint8_t *data, int size,
+                            int width, int height, AVPixelFormat pixelFmt, double pts) = 0;
+    /** 一段重采样后的PCM(交错存放), pts是所在包的时间 单位是秒*/
+    virtual void writeAudio(const uint8_t *data, int size, double pts) = 0;
+};
+
+/**
+ * 丢弃所有数据, 只测解码吞吐量
+ */
+class NullSink : public MediaSink
+{
+public:
+    void writeVideo(const uint8_t *data, int size,
+                    int width, int height, AVPixelFormat pixelFmt, double pts) override;
+    void writeAudio(const uint8_t *data, int size, double pts) override;
+};
+
+/**
+ * 画面和PCM原样写入文件, 路径为空的不写
+ */
+class RawFileSink : public MediaSink
+{
+public:
+    RawFileSink(const char *videoPath, const char *audioPath);
+    ~RawFileSink();
+
+    /** 要写的文件是否都打开了*/
+    bool isOpen();
+    void writeVideo(const uint8_t *data, int size,
+                    int width, int height, AVPixelFormat pixelFmt, double pts) override;
+    void writeAudio(const uint8_t *data, int size, double pts) override;
+
+private:
+    FILE *_videoFile = nullptr;
+    FILE *_audioFile = nullptr;
+    bool _open = true;
+};
+
+/**
+ * 画面和PCM交给回调函数, 没有设置的回调丢弃
+ */
+class CallbackSink : public MediaSink
+{
+public:
+    typedef std::function<void(const uint8_t *data, int size,
+                               int width, int height, AVPixelFormat pixelFmt, double pts)> VideoCallback;
+    typedef std::function<void(const uint8_t *data, int size, double pts)> AudioCallback;
+
+    CallbackSink(VideoCallback video, AudioCallback audio);
+
+    void writeVideo(const uint8_t *data, int size,
+                    int width, int height, AVPixelFormat pixelFmt, double pts) override;
+    void writeAudio(const uint8_t *data, int size, double pts) override;
+
+private:
+    VideoCallback _video;
+    AudioCallback _audio;
+};
+
+#endif // MEDIASINK_H
@@ -0,0 +1,170 @@
+#include "mmapio.h"
+#include <QDebug>
+#include <algorithm>
+#include <stdint.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// AVIOContext内部缓冲区大小
+#define MMAP_IO_BUFFER_SIZE (64 * 1024)
+// 每次提示预读的窗口大小
+#define MMAP_READ_AHEAD_SIZE (8 * 1024 * 1024)
+
+MmapIO::MmapIO()
+{
+
+}
+
+MmapIO::~MmapIO() {
+    close();
+}
+
+int MmapIO::open(const char *filename) {
+#ifdef _WIN32
+    Q_UNUSED(filename);
+    return -1;
+#else
+    int fd = ::open(filename, O_RDONLY);
+    if (fd < 0) {
+        qDebug() << "mmap open file error:" << filename;
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+        ::close(fd);
+        return -1;
+    }
+    // 32位系统上超过地址空间的大文件映射不了, 回退到默认读取
+    if ((uint64_t)st.st_size > SIZE_MAX) {
+        qDebug() << "mmap file too large:" << filename;
+        ::close(fd);
+        return -1;
+    }
+
+    // 只读映射整个文件, 映射建立后fd就可以关掉了
+    void *data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        qDebug() << "mmap error:" << filename;
+        return -1;
+    }
+    _data = (uint8_t *)data;
+    _size = st.st_size;
+    _pos = 0;
+    _advisedEnd = 0;
+
+    // 先把文件头部预读进来, 解封装探测格式马上就要用
+    readAhead();
+
+    // 缓冲区交给AVIOContext管理, 释放时要用它内部的buffer指针(可能被ffmpeg换掉)
+    uint8_t *buffer = (uint8_t *)av_malloc(MMAP_IO_BUFFER_SIZE);
+    if (!buffer) {
+        close();
+        return -1;
+    }
+    _avioCxt = avio_alloc_context(buffer, MMAP_IO_BUFFER_SIZE, 0, this,
+                                  MmapIO::readPacketFunc, nullptr, MmapIO::seekFunc);
+    if (!_avioCxt) {
+        av_free(buffer);
+        close();
+        return -1;
+    }
+    return 0;
+#endif
+}
+
+void MmapIO::close() {
+    if (_avioCxt) {
+        av_freep(&_avioCxt->buffer);
+        avio_context_free(&_avioCxt);
+    }
+#ifndef _WIN32
+    if (_data) {
+        munmap(_data, _size);
+    }
+#endif
+    _data = nullptr;
+    _size = 0;
+    _pos = 0;
+    _advisedEnd = 0;
+}
+
+AVIOContext *MmapIO::avioCxt() {
+    return _avioCxt;
+}
+
+int64_t MmapIO::size() {
+    return _size;
+}
+
+void MmapIO::prefetch(int64_t offset) {
+    if (!_data || offset < 0 || offset >= _size) return;
+    willNeed(offset, MMAP_READ_AHEAD_SIZE);
+}
+
+void MmapIO::readAhead() {
+    // 读取位置进入预读窗口的后半段就提示预读下一个窗口, 保证解封装读到的页都已经在内存
+    if (_pos + MMAP_READ_AHEAD_SIZE / 2 < _advisedEnd) return;
+    int64_t offset = std::max(_pos, _advisedEnd);
+    willNeed(offset, MMAP_READ_AHEAD_SIZE);
+    _advisedEnd = offset + MMAP_READ_AHEAD_SIZE;
+}
+
+void MmapIO::willNeed(int64_t offset, int64_t len) {
+#ifndef _WIN32
+    // madvise要求起始地址按页对齐
+    static const int64_t pageSize = sysconf(_SC_PAGESIZE);
+    int64_t begin = offset / pageSize * pageSize;
+    int64_t end = std::min(offset + len, _size);
+    if (end <= begin) return;
+    madvise(_data + begin, end - begin, MADV_WILLNEED);
+#else
+    Q_UNUSED(offset);
+    Q_UNUSED(len);
+#endif
+}
+
+int MmapIO::readPacketFunc(void *opaque, uint8_t *buf, int bufSize) {
+    MmapIO *io = (MmapIO *)opaque;
+    int64_t remain = io->_size - io->_pos;
+    if (remain <= 0) return AVERROR_EOF;
+
+    // 直接从映射内存拷贝, 没有read系统调用
+    int len = (int)std::min<int64_t>(remain, bufSize);
+    memcpy(buf, io->_data + io->_pos, len);
+    io->_pos += len;
+    io->readAhead();
+    return len;
+}
+
+int64_t MmapIO::seekFunc(void *opaque, int64_t offset, int whence) {
+    MmapIO *io = (MmapIO *)opaque;
+    int64_t pos;
+    switch (whence & ~AVSEEK_FORCE) {
+    case AVSEEK_SIZE:
+        return io->_size;
+    case SEEK_SET:
+        pos = offset;
+        break;
+    case SEEK_CUR:
+        pos = io->_pos + offset;
+        break;
+    case SEEK_END:
+        pos = io->_size + offset;
+        break;
+    default:
+        return AVERROR(EINVAL);
+    }
+    if (pos < 0 || pos > io->_size) return AVERROR(EINVAL);
+
+    io->_pos = pos;
+    // seek之后从新位置重新开始预读
+    io->_advisedEnd = pos;
+    io->readAhead();
+    return pos;
+}
@@ -0,0 +1,53 @@
+#ifndef MMAPIO_H
+#define MMAPIO_H
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+/**
+ * 本地文件内存映射读取
+ * 把整个文件mmap进来, 通过自定义AVIOContext交给ffmpeg解封装, 读取和seek都不再走read/lseek系统调用.
+ * 根据读取位置和seek目标用madvise提示系统提前把后面的页读进来.
+ */
+class MmapIO
+{
+public:
+    MmapIO();
+    ~MmapIO();
+
+    /** 映射文件并创建AVIOContext, 失败返回负数(不支持mmap的平台直接失败, 外界回退到默认读取)*/
+    int open(const char *filename);
+    /** 释放AVIOContext并解除映射*/
+    void close();
+    /** 给AVFormatContext->pb用的IO上下文*/
+    AVIOContext *avioCxt();
+    /** 文件大小*/
+    int64_t size();
+    /** 提示系统预读offset开始的一段数据(可以在其他线程调用, 比如seek时)*/
+    void prefetch(int64_t offset);
+
+private:
+    /** 映射的起始地址*/
+    uint8_t *_data = nullptr;
+    /** 文件大小*/
+    int64_t _size = 0;
+    /** 当前读取位置(只有读文件线程访问)*/
+    int64_t _pos = 0;
+    /** 已经提示预读到的位置*/
+    int64_t _advisedEnd = 0;
+    /** 自定义IO上下文*/
+    AVIOContext *_avioCxt = nullptr;
+
+    /** 读取位置快到预读窗口末尾时继续预读*/
+    void readAhead();
+    /** 提示系统预读[offset, offset + len)*/
+    void willNeed(int64_t offset, int64_t len);
+
+    /** AVIOContext读数据回调*/
+    static int readPacketFunc(void *opaque, uint8_t *buf, int bufSize);
+    /** AVIOContext seek回调*/
+    static int64_t seekFunc(void *opaque, int64_t offset, int whence);
+};
+
+#endif // MMAPIO_H
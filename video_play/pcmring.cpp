@@ -0,0 +1,120 @@
+#include "pcmring.h"
+#include <cstring>
+#include <algorithm>
+
+// 写位置高16位是清空次数: 消费者执行清空时加一, 正在写入的生产者发布写位置时发现变了, 丢弃这次写入
+#define PCM_RING_CLEAR_STEP (1ULL << 48)
+// 写位置低48位是一共写入的字节数
+#define PCM_RING_POS_MASK (PCM_RING_CLEAR_STEP - 1)
+
+PcmRing::PcmRing(int capacity)
+    : _capacity(capacity)
+{
+    _data = new uint8_t[_capacity];
+    _spaceSem = SDL_CreateSemaphore(0);
+}
+
+PcmRing::~PcmRing() {
+    SDL_DestroySemaphore(_spaceSem);
+    delete[] _data;
+}
+
+int PcmRing::serial() {
+    return _serial.load();
+}
+
+int PcmRing::write(const uint8_t *data, int len, int serial) {
+    // 先取写位置再检查清空请求: 检查通过之后才请求的清空, 执行时一定会让下面的发布失败
+    uint64_t current = _write.load();
+    // 清空前写进去的也会被清掉, 等消费者清空完再写; 数据是清空请求之前准备的就不写了
+    if (_clearPending.load() || _serial.load() != serial) return 0;
+
+    uint64_t write = current & PCM_RING_POS_MASK;
+    uint64_t read = _read.load(std::memory_order_acquire);
+    len = std::min(len, _capacity - (int)(write - read));
+    if (len <= 0) return 0;
+
+    // 到缓冲末尾分两段拷贝
+    int pos = write % _capacity;
+    int first = std::min(len, _capacity - pos);
+    memcpy(_data + pos, data, first);
+    memcpy(_data, data + first, len - first);
+    // 拷贝期间消费者执行了清空, 这段是清空之前的声音, 不发布
+    if (!_write.compare_exchange_strong(current, current + len)) return 0;
+    return len;
+}
+
+int PcmRing::peek(const uint8_t **data, int len) {
+    uint64_t read = _read.load(std::memory_order_relaxed);
+    uint64_t write = writePos();
+    if (_clearPending.load()) {
+        // 消费者自己移动读位置, 不会和读取冲突; 清空次数加一, 正在进行的写入发布时会失败
+        write = _write.fetch_add(PCM_RING_CLEAR_STEP) & PCM_RING_POS_MASK;
+        read = write;
+        _read.store(read, std::memory_order_release);
+        _clearPending.store(false, std::memory_order_release);
+        notifyProducer();
+    }
+
+    int pos = read % _capacity;
+    len = std::min(len, (int)(write - read));
+    len = std::min(len, _capacity - pos);
+    *data = _data + pos;
+    return std::max(len, 0);
+}
+
+void PcmRing::consume(int len) {
+    _read.fetch_add(len, std::memory_order_release);
+    notifyProducer();
+}
+
+void PcmRing::clear() {
+    _serial++;
+    _clearPending.store(true);
+}
+
+bool PcmRing::isClearPending() {
+    return _clearPending.load(std::memory_order_acquire);
+}
+
+void PcmRing::waitForSpace(Uint32 ms) {
+    // 先标记等待再检查空位, 和notifyProducer的读标记、移动读位置至少有一方能看到另一方
+    _producerWaiting.store(true);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (space() == 0) {
+        SDL_SemWaitTimeout(_spaceSem, ms);
+    }
+    // 没有被唤醒就自己清掉标记; 已经被清掉说明消费者发了信号, 取走这次信号, 下次等待不会马上返回
+    if (!_producerWaiting.exchange(false)) {
+        SDL_SemTryWait(_spaceSem);
+    }
+}
+
+void PcmRing::wakeup() {
+    notifyProducer();
+}
+
+void PcmRing::notifyProducer() {
+    // 生产者没有挂起就不发信号; 抢到标记的才发, 一次等待最多一个信号
+    // 读标记前的栅栏和waitForSpace里的配对, 不会两边都没看到对方
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (_producerWaiting.load() && _producerWaiting.exchange(false)) {
+        SDL_SemPost(_spaceSem);
+    }
+}
+
+uint64_t PcmRing::writePos() {
+    return _write.load(std::memory_order_acquire) & PCM_RING_POS_MASK;
+}
+
+int PcmRing::available() {
+    return (int)(writePos() - _read.load(std::memory_order_acquire));
+}
+
+int PcmRing::space() {
+    return _capacity - available();
+}
+
+int PcmRing::capacity() {
+    return _capacity;
+}
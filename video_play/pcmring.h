@@ -0,0 +1,65 @@
+#ifndef PCMRING_H
+#define PCMRING_H
+
+#include <SDL2/SDL.h>
+#include <atomic>
+#include <cstdint>
+
+/**
+ * PCM环形缓冲
+ * 音频解码线程写入(生产者), SDL音频回调读出(消费者), 读写都不加锁, 音频回调里不会被解码线程阻塞.
+ * 清空由消费者下次读取时执行, 其他线程只是发出请求, 不会和正在进行的读取冲突;
+ * 清空请求之前开始的写入会被丢弃, 不会在清空之后才出现在缓冲里.
+ * 缓冲满了生产者挂起, 消费者取走数据后唤醒它(信号量, 回调里不加锁).
+ */
+class PcmRing
+{
+public:
+    /** capacity: 容量 单位是字节*/
+    PcmRing(int capacity);
+    ~PcmRing();
+
+    /** 清空请求的次数, 生产者准备写入的数据之前取出, 写入时传给write*/
+    int serial();
+    /**
+     * 写入(生产者调用), 返回写入的字节数, 空间不够只写一部分
+     * serial之后请求过清空(数据是清空之前的)、或者清空请求还没执行时不写入
+     */
+    int write(const uint8_t *data, int len, int serial);
+    /** 读位置开始连续可读的数据(消费者调用), 最多len字节, 到缓冲末尾要分两次读; 返回可读字节数*/
+    int peek(const uint8_t **data, int len);
+    /** 读完peek到的数据后移动读位置(消费者调用)*/
+    void consume(int len);
+    /** 请求清空(任何线程调用, seek时), 消费者下次peek时执行*/
+    void clear();
+    /** 是否有还没执行的清空请求*/
+    bool isClearPending();
+    /** 生产者挂起, 直到有空位、被wakeup唤醒或者超时 单位是毫秒*/
+    void waitForSpace(Uint32 ms);
+    /** 唤醒挂起的生产者(停止时调用)*/
+    void wakeup();
+    /** 可读的字节数*/
+    int available();
+    /** 可写的字节数*/
+    int space();
+    int capacity();
+
+private:
+    uint8_t *_data = nullptr;
+    int _capacity = 0;
+    /** 一共写入\读出了多少字节, 相减就是可读的字节数; 写位置的高位是消费者执行清空的次数*/
+    std::atomic<uint64_t> _write{0};
+    std::atomic<uint64_t> _read{0};
+    std::atomic<bool> _clearPending{false};
+    std::atomic<int> _serial{0};
+    /** 生产者是否在挂起等待空位*/
+    std::atomic<bool> _producerWaiting{false};
+    SDL_sem *_spaceSem = nullptr;
+
+    /** 写位置(去掉清空次数)*/
+    uint64_t writePos();
+    /** 有空位了, 唤醒挂起的生产者(消费者调用, 不加锁)*/
+    void notifyProducer();
+};
+
+#endif // PCMRING_H
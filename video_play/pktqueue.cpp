@@ -0,0 +1,167 @@
+#include "pktqueue.h"
+
+PktQueue::PktQueue(int capacity, int64_t maxBytes, int64_t maxDuration)
+    : _capacity(capacity), _maxBytes(maxBytes), _maxDuration(maxDuration)
+{
+    // 槽位一次分配好, 之后放入取出包不再申请内存
+    _slots = new Slot[_capacity];
+}
+
+PktQueue::~PktQueue() {
+    clear();
+    delete[] _slots;
+}
+
+void PktQueue::setTimeBase(AVRational timeBase) {
+    _timeBase = timeBase;
+}
+
+bool PktQueue::push(AVPacket &pkt) {
+    uint64_t head = _head.load(std::memory_order_relaxed);
+    if (head - _tail.load(std::memory_order_acquire) >= (uint64_t)_capacity) {
+        return false;
+    }
+
+    // 包时长, 没有duration就用相邻两个包的时间戳差值
+    int64_t ts = pkt.dts != AV_NOPTS_VALUE ? pkt.dts : pkt.pts;
+    int64_t duration = pkt.duration;
+    if (duration <= 0 && ts != AV_NOPTS_VALUE && _lastTs != AV_NOPTS_VALUE && ts > _lastTs) {
+        duration = ts - _lastTs;
+    }
+    if (ts != AV_NOPTS_VALUE) {
+        _lastTs = ts;
+    }
+
+    Slot &slot = _slots[head % _capacity];
+    slot.pkt = pkt;
+    slot.duration = (duration > 0 && _timeBase.num) ? av_rescale_q(duration, _timeBase, AV_TIME_BASE_Q) : 0;
+
+    _bytes += pkt.size;
+    _duration += slot.duration;
+    // 槽位写好之后才移动写位置, 消费者看到新位置时一定能读到完整的包
+    _head.store(head + 1, std::memory_order_release);
+    notifyConsumer();
+    return true;
+}
+
+bool PktQueue::pop(AVPacket &pkt) {
+    if (!take(pkt)) return false;
+    notifyProducer();
+    return true;
+}
+
+bool PktQueue::take(AVPacket &pkt) {
+    uint64_t tail = _tail.load(std::memory_order_acquire);
+    while (tail != _head.load(std::memory_order_acquire)) {
+        // 先拷贝出槽位内容再CAS抢读位置, 抢失败说明被clear拿走了, 拷贝出来的内容直接丢弃
+        Slot slot = _slots[tail % _capacity];
+        if (_tail.compare_exchange_weak(tail, tail + 1,
+                                        std::memory_order_acq_rel,
+                                        std::memory_order_acquire)) {
+            _bytes -= slot.pkt.size;
+            _duration -= slot.duration;
+            pkt = slot.pkt;
+            return true;
+        }
+    }
+    return false;
+}
+
+void PktQueue::clear() {
+    AVPacket pkt;
+    while (take(pkt)) {
+        av_packet_unref(&pkt);
+    }
+    _lastTs = AV_NOPTS_VALUE;
+    notifyProducer();
+}
+
+bool PktQueue::isFull() {
+    return _head.load() - _tail.load() >= (uint64_t)_capacity
+            || _bytes.load() >= _maxBytes
+            || _duration.load() >= _maxDuration;
+}
+
+bool PktQueue::isEmpty() {
+    return _head.load() == _tail.load();
+}
+
+int PktQueue::size() {
+    return (int)(_head.load() - _tail.load());
+}
+
+int64_t PktQueue::bytes() {
+    return _bytes.load();
+}
+
+int64_t PktQueue::duration() {
+    return _duration.load();
+}
+
+void PktQueue::waitForSpace() {
+    _mutex.lock();
+    // 先标记等待再检查是否满, 消费者取出包后一定能看到标记
+    _producerWaiting = true;
+    // 和notifyProducer里的栅栏配对: 标记和读位置的修改至少有一方能看到另一方
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    while (isFull() && !_wakeupProducer) {
+        _mutex.wait();
+    }
+    _producerWaiting = false;
+    _wakeupProducer = false;
+    _mutex.unlock();
+}
+
+void PktQueue::waitForEmpty() {
+    _mutex.lock();
+    _producerWaiting = true;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    while (!isEmpty() && !_wakeupProducer) {
+        _mutex.wait();
+    }
+    _producerWaiting = false;
+    _wakeupProducer = false;
+    _mutex.unlock();
+}
+
+void PktQueue::waitForData() {
+    _mutex.lock();
+    // 先标记等待再检查是否空, 生产者放入包后一定能看到标记
+    _consumerWaiting = true;
+    // 和notifyConsumer里的栅栏配对
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    while (isEmpty() && !_wakeupConsumer) {
+        _mutex.wait();
+    }
+    _consumerWaiting = false;
+    _wakeupConsumer = false;
+    _mutex.unlock();
+}
+
+void PktQueue::wakeup() {
+    _mutex.lock();
+    _wakeupProducer = true;
+    _wakeupConsumer = true;
+    _mutex.broadcast();
+    _mutex.unlock();
+}
+
+void PktQueue::notifyProducer() {
+    // 生产者没有挂起就不用加锁, 消费者取包保持无锁
+    // 读标记之前要有栅栏: 前面修改读位置的CAS只是acq_rel, 否则可能和生产者的"写标记再读位置"互相看不到, 丢掉唤醒
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!_producerWaiting.load()) return;
+    _mutex.lock();
+    _mutex.broadcast();
+    _mutex.unlock();
+}
+
+void PktQueue::notifyConsumer() {
+    // 消费者没有挂起就不用加锁, 生产者放包保持无锁
+    // 前面写位置是release写, 同notifyProducer要先加栅栏再读标记
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!_consumerWaiting.load()) return;
+    _mutex.lock();
+    _mutex.broadcast();
+    _mutex.unlock();
+}
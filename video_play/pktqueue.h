@@ -0,0 +1,95 @@
+#ifndef PKTQUEUE_H
+#define PKTQUEUE_H
+
+#include <atomic>
+#include "condmutex.h"
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+/**
+ * 音视频包环形队列
+ * 一个读文件线程放入(生产者), 一个解码线程取出(消费者), 槽位在创建时一次分配好, push/pop不加锁.
+ * 队列上限按槽位数、字节数、缓存时长三个维度限制, 满了之后生产者挂起等待, 不再空转.
+ */
+class PktQueue
+{
+public:
+    /**
+     * capacity: 槽位数
+     * maxBytes: 最多缓存多少字节的包数据
+     * maxDuration: 最多缓存多长时间的包 单位是微妙
+     */
+    PktQueue(int capacity, int64_t maxBytes, int64_t maxDuration);
+    ~PktQueue();
+
+    /** 设置流的时间基, 用于换算包时长*/
+    void setTimeBase(AVRational timeBase);
+    /** 放入包(生产者调用), pkt的引用交给队列, 没有空槽位返回false*/
+    bool push(AVPacket &pkt);
+    /** 取出包(消费者调用), 队列为空返回false*/
+    bool pop(AVPacket &pkt);
+    /** 清空队列, 生产者和消费者线程都可以调用*/
+    void clear();
+    /** 槽位、字节数、时长任意一个达到上限就算满*/
+    bool isFull();
+    /** 是否为空*/
+    bool isEmpty();
+    /** 包个数*/
+    int size();
+    /** 缓存的包数据字节数*/
+    int64_t bytes();
+    /** 缓存的时长 单位是微妙*/
+    int64_t duration();
+    /** 生产者挂起, 直到队列不满或者被wakeup唤醒*/
+    void waitForSpace();
+    /** 生产者挂起, 直到队列被取空或者被wakeup唤醒(读到文件尾部时调用)*/
+    void waitForEmpty();
+    /** 消费者挂起, 直到有包放入或者被wakeup唤醒*/
+    void waitForData();
+    /** 唤醒挂起的生产者和消费者(seek, 暂停, 停止时调用)*/
+    void wakeup();
+
+private:
+    typedef struct {
+        AVPacket pkt;
+        /** 包时长 单位是微妙*/
+        int64_t duration;
+    } Slot;
+
+    /** 预分配的槽位*/
+    Slot *_slots = nullptr;
+    int _capacity = 0;
+    int64_t _maxBytes = 0;
+    int64_t _maxDuration = 0;
+    /** 流的时间基*/
+    AVRational _timeBase = {0, 1};
+    /** 上一个放入包的时间戳, 包没有duration时用相邻时间戳相减估算(只有生产者访问)*/
+    int64_t _lastTs = AV_NOPTS_VALUE;
+
+    /** 写位置(只有生产者修改)*/
+    std::atomic<uint64_t> _head{0};
+    /** 读位置(消费者和clear通过CAS竞争修改)*/
+    std::atomic<uint64_t> _tail{0};
+    std::atomic<int64_t> _bytes{0};
+    std::atomic<int64_t> _duration{0};
+
+    /** 生产者是否在挂起等待*/
+    std::atomic<bool> _producerWaiting{false};
+    /** 消费者是否在挂起等待*/
+    std::atomic<bool> _consumerWaiting{false};
+    /** 是否被外部唤醒, 生产者和消费者各用一个, 在挂起前设置也不会丢失*/
+    bool _wakeupProducer = false;
+    bool _wakeupConsumer = false;
+    /** 挂起用的锁*/
+    CondMutex _mutex;
+
+    /** 抢占读位置上的包, 成功则包的引用归调用者*/
+    bool take(AVPacket &pkt);
+    /** 唤醒在等待空位的生产者*/
+    void notifyProducer();
+    /** 唤醒在等待包的消费者*/
+    void notifyConsumer();
+};
+
+#endif // PKTQUEUE_H
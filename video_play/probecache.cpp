@@ -0,0 +1,140 @@
+#include "probecache.h"
+#include "mediacache.h"
+#include <QDebug>
+#include <QFile>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QByteArray>
+#include <vector>
+
+// 缓存文件标识和版本, 格式变化时修改版本号让旧缓存失效
+#define PROBE_CACHE_MAGIC 0x50524F42
+#define PROBE_CACHE_VERSION 1
+
+// 缓存的单条流参数
+typedef struct {
+    qint32 codecType, codecId, format, profile, level, width, height;
+    qint32 sarNum, sarDen, colorRange, colorSpace, videoDelay;
+    quint64 channelLayout;
+    qint32 channels, sampleRate, frameSize, blockAlign;
+    quint32 codecTag;
+    qint64 codecBitRate;
+    QByteArray extradata;
+    qint32 tbNum, tbDen, avgNum, avgDen, rNum, rDen;
+    qint64 streamStart, streamDuration;
+} StreamParams;
+
+bool ProbeCache::read(const char *filename, AVFormatContext *fmtCxt) {
+    QFile file(MediaCache::filePath(filename, "probe", ".probe"));
+    if (!file.open(QIODevice::ReadOnly)) return false;
+
+    QDataStream in(&file);
+    quint32 magic, version, nbStreams;
+    qint64 duration, startTime, bitRate;
+    in >> magic >> version >> nbStreams >> duration >> startTime >> bitRate;
+    if (in.status() != QDataStream::Ok
+            || magic != PROBE_CACHE_MAGIC
+            || version != PROBE_CACHE_VERSION
+            || nbStreams != fmtCxt->nb_streams) {
+        return false;
+    }
+
+    // 先全部读出来校验, 都对得上才填到流参数里, 避免填了一半
+    std::vector<StreamParams> params(nbStreams);
+    for (quint32 i = 0; i < nbStreams; i++) {
+        StreamParams &p = params[i];
+        in >> p.codecType >> p.codecId >> p.codecTag >> p.format >> p.codecBitRate
+           >> p.profile >> p.level >> p.width >> p.height >> p.sarNum >> p.sarDen
+           >> p.colorRange >> p.colorSpace >> p.videoDelay
+           >> p.channelLayout >> p.channels >> p.sampleRate >> p.frameSize >> p.blockAlign
+           >> p.extradata
+           >> p.tbNum >> p.tbDen >> p.avgNum >> p.avgDen >> p.rNum >> p.rDen
+           >> p.streamStart >> p.streamDuration;
+        if (in.status() != QDataStream::Ok) return false;
+
+        // 流的类型和时间基是解封装打开时就确定的, 对不上说明不是同一份探测结果
+        AVStream *stream = fmtCxt->streams[i];
+        if (p.codecType != stream->codecpar->codec_type
+                || p.tbNum != stream->time_base.num
+                || p.tbDen != stream->time_base.den) {
+            return false;
+        }
+    }
+
+    for (quint32 i = 0; i < nbStreams; i++) {
+        StreamParams &p = params[i];
+        AVStream *stream = fmtCxt->streams[i];
+        AVCodecParameters *par = stream->codecpar;
+        par->codec_id = (AVCodecID)p.codecId;
+        par->codec_tag = p.codecTag;
+        par->format = p.format;
+        par->bit_rate = p.codecBitRate;
+        par->profile = p.profile;
+        par->level = p.level;
+        par->width = p.width;
+        par->height = p.height;
+        par->sample_aspect_ratio = {p.sarNum, p.sarDen};
+        par->color_range = (AVColorRange)p.colorRange;
+        par->color_space = (AVColorSpace)p.colorSpace;
+        par->video_delay = p.videoDelay;
+        par->channel_layout = p.channelLayout;
+        par->channels = p.channels;
+        par->sample_rate = p.sampleRate;
+        par->frame_size = p.frameSize;
+        par->block_align = p.blockAlign;
+        if (!p.extradata.isEmpty()) {
+            // extradata要多分配padding, 解码器读数据可能越过末尾
+            av_freep(&par->extradata);
+            par->extradata = (uint8_t *)av_mallocz(p.extradata.size() + AV_INPUT_BUFFER_PADDING_SIZE);
+            if (par->extradata) {
+                memcpy(par->extradata, p.extradata.constData(), p.extradata.size());
+                par->extradata_size = p.extradata.size();
+            }
+        }
+        stream->avg_frame_rate = {p.avgNum, p.avgDen};
+        stream->r_frame_rate = {p.rNum, p.rDen};
+        stream->start_time = p.streamStart;
+        stream->duration = p.streamDuration;
+    }
+    fmtCxt->duration = duration;
+    fmtCxt->start_time = startTime;
+    fmtCxt->bit_rate = bitRate;
+    return true;
+}
+
+void ProbeCache::write(const char *filename, AVFormatContext *fmtCxt) {
+    QString path = MediaCache::filePath(filename, "probe", ".probe");
+    MediaCache::makeDir(path);
+    // 先写临时文件再替换, 写到一半退出也不会留下损坏的缓存
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "probe cache open error:" << path;
+        return;
+    }
+
+    QDataStream out(&file);
+    out << (quint32)PROBE_CACHE_MAGIC
+        << (quint32)PROBE_CACHE_VERSION
+        << (quint32)fmtCxt->nb_streams
+        << (qint64)fmtCxt->duration
+        << (qint64)fmtCxt->start_time
+        << (qint64)fmtCxt->bit_rate;
+    for (unsigned int i = 0; i < fmtCxt->nb_streams; i++) {
+        AVStream *stream = fmtCxt->streams[i];
+        AVCodecParameters *par = stream->codecpar;
+        out << (qint32)par->codec_type << (qint32)par->codec_id << (quint32)par->codec_tag
+            << (qint32)par->format << (qint64)par->bit_rate
+            << (qint32)par->profile << (qint32)par->level
+            << (qint32)par->width << (qint32)par->height
+            << (qint32)par->sample_aspect_ratio.num << (qint32)par->sample_aspect_ratio.den
+            << (qint32)par->color_range << (qint32)par->color_space << (qint32)par->video_delay
+            << (quint64)par->channel_layout << (qint32)par->channels
+            << (qint32)par->sample_rate << (qint32)par->frame_size << (qint32)par->block_align
+            << QByteArray((const char *)par->extradata, par->extradata ? par->extradata_size : 0)
+            << (qint32)stream->time_base.num << (qint32)stream->time_base.den
+            << (qint32)stream->avg_frame_rate.num << (qint32)stream->avg_frame_rate.den
+            << (qint32)stream->r_frame_rate.num << (qint32)stream->r_frame_rate.den
+            << (qint64)stream->start_time << (qint64)stream->duration;
+    }
+    file.commit();
+}
@@ -0,0 +1,22 @@
+#ifndef PROBECACHE_H
+#define PROBECACHE_H
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+/**
+ * 文件探测结果缓存
+ * avformat_find_stream_info要解码一部分数据才能拿到流参数, 大文件很慢.
+ * 第一次打开时把探测到的流参数保存下来, 之后再打开同一个文件直接填回去, 跳过探测.
+ */
+class ProbeCache
+{
+public:
+    /** 把缓存的探测结果填到fmtCxt的流参数里, 成功说明可以跳过avformat_find_stream_info*/
+    static bool read(const char *filename, AVFormatContext *fmtCxt);
+    /** 保存fmtCxt的探测结果*/
+    static void write(const char *filename, AVFormatContext *fmtCxt);
+};
+
+#endif // PROBECACHE_H
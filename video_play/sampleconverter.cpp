@@ -0,0 +1,220 @@
+#include "sampleconverter.h"
+#include <math.h>
+extern "C" {
+#include <libavutil/cpu.h>
+#include <libavutil/channel_layout.h>
+}
+
+// 只在x86上提供SIMD实现, 用函数级别的target属性编译, 不需要给整个工程加编译选项
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define SAMPLE_CONVERTER_X86 1
+#include <emmintrin.h>
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#elif defined(_M_X64)
+#define SAMPLE_CONVERTER_X86 1
+#include <emmintrin.h>
+#define TARGET_SSE2
+#endif
+
+// 声道转换方式
+#define MODE_INTERLEAVE 0 // 声道布局不变, 平面存放改成交错存放
+#define MODE_MONO_TO_STEREO 1 // 单声道复制到左右声道
+
+// 单声道转立体声每个声道的音量, 和swresample默认的混音矩阵一样降低3dB
+#define MONO_TO_STEREO_GAIN 0.70710678f
+
+#pragma mark - C实现
+// 样本转换成float, 和swresample的公式一样
+static inline float toFloat(float x) {
+    return x;
+}
+
+static inline float toFloat(int16_t x) {
+    return x * (1.0f / (1 << 15));
+}
+
+// float转换成输出格式, s16先截断再四舍五入(默认舍入模式是四舍五入到偶数, 和SSE2的转换一致)
+template<typename Out>
+static inline Out fromFloat(float x);
+
+template<>
+inline float fromFloat<float>(float x) {
+    return x;
+}
+
+template<>
+inline int16_t fromFloat<int16_t>(float x) {
+    x *= (1 << 15);
+    x = x < -32768.0f ? -32768.0f : (x > 32767.0f ? 32767.0f : x);
+    return (int16_t)lrintf(x);
+}
+
+// 从第x个样本开始转换到末尾, 也用来处理SIMD剩下的样本
+template<typename In, typename Out, int MODE>
+static void convertC(const uint8_t * const *src, uint8_t *dst, int x, int samples, int chs) {
+    Out *out = (Out *)dst;
+    if (MODE == MODE_MONO_TO_STEREO) {
+        const In *in = (const In *)src[0];
+        for (; x < samples; x++) {
+            Out s = fromFloat<Out>(toFloat(in[x]) * MONO_TO_STEREO_GAIN);
+            out[2 * x] = s;
+            out[2 * x + 1] = s;
+        }
+    }else {
+        for (; x < samples; x++) {
+            for (int ch = 0; ch < chs; ch++) {
+                out[x * chs + ch] = fromFloat<Out>(toFloat(((const In *)src[ch])[x]));
+            }
+        }
+    }
+}
+
+template<typename In, typename Out, int MODE>
+static void convertAllC(const uint8_t * const *src, uint8_t *dst, int samples, int chs) {
+    convertC<In, Out, MODE>(src, dst, 0, samples, chs);
+}
+
+#ifdef SAMPLE_CONVERTER_X86
+#pragma mark - SSE2 一次8个样本
+// 读8个样本转成float
+TARGET_SSE2 static inline void load8(const float *p, __m128 &lo, __m128 &hi) {
+    lo = _mm_loadu_ps(p);
+    hi = _mm_loadu_ps(p + 4);
+}
+
+TARGET_SSE2 static inline void load8(const int16_t *p, __m128 &lo, __m128 &hi) {
+    __m128i x = _mm_loadu_si128((const __m128i *)p);
+    // 复制到32位的高16位再算术右移, 就是符号扩展
+    __m128i lo32 = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+    __m128i hi32 = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+    __m128 scale = _mm_set1_ps(1.0f / (1 << 15));
+    lo = _mm_mul_ps(_mm_cvtepi32_ps(lo32), scale);
+    hi = _mm_mul_ps(_mm_cvtepi32_ps(hi32), scale);
+}
+
+// 写16个已经交错好的float样本
+TARGET_SSE2 static inline void store16(float *p, __m128 a, __m128 b, __m128 c, __m128 d) {
+    _mm_storeu_ps(p, a);
+    _mm_storeu_ps(p + 4, b);
+    _mm_storeu_ps(p + 8, c);
+    _mm_storeu_ps(p + 12, d);
+}
+
+TARGET_SSE2 static inline __m128i toS16x4(__m128 x) {
+    __m128 scale = _mm_set1_ps(1 << 15);
+    x = _mm_mul_ps(x, scale);
+    // 先截断再转换, 超出32位整数的值转换结果不确定
+    x = _mm_max_ps(_mm_min_ps(x, _mm_set1_ps(32767.0f)), _mm_set1_ps(-32768.0f));
+    return _mm_cvtps_epi32(x);
+}
+
+TARGET_SSE2 static inline void store16(int16_t *p, __m128 a, __m128 b, __m128 c, __m128 d) {
+    _mm_storeu_si128((__m128i *)p, _mm_packs_epi32(toS16x4(a), toS16x4(b)));
+    _mm_storeu_si128((__m128i *)(p + 8), _mm_packs_epi32(toS16x4(c), toS16x4(d)));
+}
+
+// 立体声两个平面交错存放
+template<typename In, typename Out>
+TARGET_SSE2 static void stereoSse2(const uint8_t * const *src, uint8_t *dst, int samples, int chs) {
+    const In *l = (const In *)src[0];
+    const In *r = (const In *)src[1];
+    Out *out = (Out *)dst;
+    int x = 0;
+    for (; x + 8 <= samples; x += 8) {
+        __m128 l0, l1, r0, r1;
+        load8(l + x, l0, l1);
+        load8(r + x, r0, r1);
+        store16(out + 2 * x,
+                _mm_unpacklo_ps(l0, r0), _mm_unpackhi_ps(l0, r0),
+                _mm_unpacklo_ps(l1, r1), _mm_unpackhi_ps(l1, r1));
+    }
+    convertC<In, Out, MODE_INTERLEAVE>(src, dst, x, samples, chs);
+}
+
+// s16p转s16不需要经过float, 直接按16位交错
+TARGET_SSE2 static void stereoS16Sse2(const uint8_t * const *src, uint8_t *dst, int samples, int chs) {
+    const int16_t *l = (const int16_t *)src[0];
+    const int16_t *r = (const int16_t *)src[1];
+    int16_t *out = (int16_t *)dst;
+    int x = 0;
+    for (; x + 8 <= samples; x += 8) {
+        __m128i lx = _mm_loadu_si128((const __m128i *)(l + x));
+        __m128i rx = _mm_loadu_si128((const __m128i *)(r + x));
+        _mm_storeu_si128((__m128i *)(out + 2 * x), _mm_unpacklo_epi16(lx, rx));
+        _mm_storeu_si128((__m128i *)(out + 2 * x + 8), _mm_unpackhi_epi16(lx, rx));
+    }
+    convertC<int16_t, int16_t, MODE_INTERLEAVE>(src, dst, x, samples, chs);
+}
+
+// 单声道复制到左右声道
+template<typename In, typename Out>
+TARGET_SSE2 static void monoSse2(const uint8_t * const *src, uint8_t *dst, int samples, int chs) {
+    const In *in = (const In *)src[0];
+    Out *out = (Out *)dst;
+    __m128 gain = _mm_set1_ps(MONO_TO_STEREO_GAIN);
+    int x = 0;
+    for (; x + 8 <= samples; x += 8) {
+        __m128 m0, m1;
+        load8(in + x, m0, m1);
+        m0 = _mm_mul_ps(m0, gain);
+        m1 = _mm_mul_ps(m1, gain);
+        store16(out + 2 * x,
+                _mm_unpacklo_ps(m0, m0), _mm_unpackhi_ps(m0, m0),
+                _mm_unpacklo_ps(m1, m1), _mm_unpackhi_ps(m1, m1));
+    }
+    convertC<In, Out, MODE_MONO_TO_STEREO>(src, dst, x, samples, chs);
+}
+#endif
+
+#pragma mark - 分派
+bool SampleConverter::isSimd() {
+#ifdef SAMPLE_CONVERTER_X86
+    // 局部静态变量只初始化一次, 多线程安全; x86-64一定有SSE2
+    static bool sse2 = av_get_cpu_flags() & AV_CPU_FLAG_SSE2;
+    return sse2;
+#else
+    return false;
+#endif
+}
+
+// In\Out是输入输出的样本类型, 立体声用SIMD实现, 其他声道数用C实现
+template<typename In, typename Out>
+static SampleConverter::Func findFunc(int mode, int chs) {
+#ifdef SAMPLE_CONVERTER_X86
+    if (SampleConverter::isSimd()) {
+        if (mode == MODE_MONO_TO_STEREO) return monoSse2<In, Out>;
+        if (chs == 2) return stereoSse2<In, Out>;
+    }
+#endif
+    if (mode == MODE_MONO_TO_STEREO) return convertAllC<In, Out, MODE_MONO_TO_STEREO>;
+    return convertAllC<In, Out, MODE_INTERLEAVE>;
+}
+
+SampleConverter::Func SampleConverter::find(AVSampleFormat inFmt, int64_t inLayout,
+                                            AVSampleFormat outFmt, int64_t outLayout) {
+    int chs = av_get_channel_layout_nb_channels(inLayout);
+    int mode;
+    if (inLayout == outLayout) {
+        mode = MODE_INTERLEAVE;
+    }else if (inLayout == AV_CH_LAYOUT_MONO && outLayout == AV_CH_LAYOUT_STEREO) {
+        mode = MODE_MONO_TO_STEREO;
+    }else {
+        return nullptr;
+    }
+
+    // 输入要是平面存放的(单声道平面和交错一样), 输出要是交错存放的
+    if (av_sample_fmt_is_planar(outFmt)) return nullptr;
+    if (!av_sample_fmt_is_planar(inFmt) && chs != 1) return nullptr;
+
+    AVSampleFormat in = av_get_packed_sample_fmt(inFmt);
+    if (in == AV_SAMPLE_FMT_S16 && outFmt == AV_SAMPLE_FMT_S16) {
+#ifdef SAMPLE_CONVERTER_X86
+        if (isSimd() && mode == MODE_INTERLEAVE && chs == 2) return stereoS16Sse2;
+#endif
+        return findFunc<int16_t, int16_t>(mode, chs);
+    }
+    if (in == AV_SAMPLE_FMT_S16 && outFmt == AV_SAMPLE_FMT_FLT) return findFunc<int16_t, float>(mode, chs);
+    if (in == AV_SAMPLE_FMT_FLT && outFmt == AV_SAMPLE_FMT_S16) return findFunc<float, int16_t>(mode, chs);
+    if (in == AV_SAMPLE_FMT_FLT && outFmt == AV_SAMPLE_FMT_FLT) return findFunc<float, float>(mode, chs);
+    return nullptr;
+}
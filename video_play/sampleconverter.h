@@ -0,0 +1,27 @@
+#ifndef SAMPLECONVERTER_H
+#define SAMPLECONVERTER_H
+
+#include <cstdint>
+extern "C" {
+#include <libavutil/samplefmt.h>
+}
+
+/**
+ * 采样率不变时的采样格式专用转换
+ * 常见的fltp\s16p(aac、opus、mp3解码出来的格式)转成交错存放的s16\flt, 以及单声道转立体声,
+ * 按模板展开每种输入输出组合, x86上用SSE2一次处理8个样本, 其他组合和需要改采样率的由外界回退到swr_convert.
+ * 转换公式和swresample一致(四舍五入到偶数、超出范围截断, 单声道转立体声降低3dB), 切换到swr时声音不会跳变.
+ */
+class SampleConverter
+{
+public:
+    /** 转换函数: src是每个声道的平面(单声道只有一个), dst交错存放, samples是每个声道的样本数, chs是声道数*/
+    typedef void (*Func)(const uint8_t * const *src, uint8_t *dst, int samples, int chs);
+
+    /** 找输入格式转换成输出格式的专用转换(声道布局要一样, 或者单声道转立体声), 没有返回nullptr*/
+    static Func find(AVSampleFormat inFmt, int64_t inLayout, AVSampleFormat outFmt, int64_t outLayout);
+    /** 是否用了SIMD实现, 用于打印*/
+    static bool isSimd();
+};
+
+#endif // SAMPLECONVERTER_H
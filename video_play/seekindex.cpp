@@ -0,0 +1,206 @@
+#include "seekindex.h"
+#include "mediacache.h"
+#include <QDebug>
+#include <QFile>
+#include <QSaveFile>
+#include <QDataStream>
+#include <algorithm>
+
+// 缓存文件标识和版本, 格式变化时修改版本号让旧缓存失效
+#define SEEK_INDEX_MAGIC 0x4B464958
+#define SEEK_INDEX_VERSION 2
+// 连续读错这么多次就认为文件后面读不下去了, 保留已经建好的部分索引
+#define SEEK_INDEX_MAX_ERRORS 100
+
+SeekIndex::SeekIndex()
+{
+
+}
+
+SeekIndex::~SeekIndex() {
+    cancel();
+}
+
+void SeekIndex::load(const char *filename, int streamIdx, AVRational timeBase) {
+    cancel();
+
+    _filename = filename;
+    _streamIdx = streamIdx;
+    _timeBase = timeBase;
+    _cachePath = MediaCache::filePath(filename, "seekindex", ".idx");
+
+    // 有缓存直接用
+    if (readCache()) {
+        _ready = true;
+        qDebug() << "seek index loaded" << _entries.size() << "key frames";
+        return;
+    }
+
+    // 没有缓存, 后台线程读一遍文件建立索引, 不影响播放
+    _cancel = false;
+    _thread = std::thread([this]() {
+        build();
+    });
+}
+
+void SeekIndex::cancel() {
+    _cancel = true;
+    if (_thread.joinable()) {
+        _thread.join();
+    }
+    _ready = false;
+    _entries.clear();
+    _end = INT64_MAX;
+}
+
+bool SeekIndex::isReady() {
+    return _ready;
+}
+
+bool SeekIndex::find(int64_t pts, Entry &entry) {
+    // 只建了一部分的索引, 超出读到的范围不知道前面最近的关键帧是哪个
+    if (!_ready || _entries.empty() || pts > _end) return false;
+
+    // 二分查找第一个时间戳大于pts的关键帧, 它前面一个就是要找的
+    size_t begin = 0, end = _entries.size();
+    while (begin < end) {
+        size_t mid = (begin + end) >> 1;
+        if (_entries[mid].pts <= pts) {
+            begin = mid + 1;
+        }else {
+            end = mid;
+        }
+    }
+    entry = _entries[begin ? begin - 1 : 0];
+    return true;
+}
+
+void SeekIndex::build() {
+    AVFormatContext *fmtCxt = nullptr;
+    int ret = avformat_open_input(&fmtCxt, _filename.c_str(), nullptr, nullptr);
+    if (ret < 0 || _streamIdx >= (int)fmtCxt->nb_streams) {
+        avformat_close_input(&fmtCxt);
+        return;
+    }
+
+    // 只关心视频流, 其他流让解封装直接丢掉
+    for (unsigned int i = 0; i < fmtCxt->nb_streams; i++) {
+        fmtCxt->streams[i]->discard = (int)i == _streamIdx ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+    }
+
+    std::vector<Entry> entries;
+    AVPacket pkt;
+    // 读到的最大时间戳, 中途读不下去时索引只覆盖到这里
+    int64_t end = INT64_MIN;
+    bool complete = false;
+    int errors = 0;
+    while (!_cancel) {
+        ret = av_read_frame(fmtCxt, &pkt);
+        if (ret == AVERROR_EOF) {
+            complete = true;
+            break;
+        }
+        // 暂时读不到或者包损坏(建索引就是为了损坏的文件), 跳过接着读; 一直读错说明读不下去了, 保留前面建好的部分
+        if (ret < 0) {
+            if ((ret == AVERROR(EAGAIN) || ret == AVERROR_INVALIDDATA) && ++errors < SEEK_INDEX_MAX_ERRORS) {
+                continue;
+            }
+            qDebug() << "seek index read error" << ret << "keep" << entries.size() << "key frames";
+            break;
+        }
+        errors = 0;
+
+        if (pkt.stream_index == _streamIdx) {
+            int64_t pts = pkt.pts != AV_NOPTS_VALUE ? pkt.pts : pkt.dts;
+            if (pkt.flags & AV_PKT_FLAG_KEY) {
+                Entry entry;
+                entry.pts = pts;
+                entry.pos = pkt.pos;
+                entry.frames = 0;
+                if (entry.pts != AV_NOPTS_VALUE) {
+                    entries.push_back(entry);
+                }
+            }
+            // 记录当前GOP的帧数
+            if (!entries.empty()) {
+                entries.back().frames++;
+            }
+            if (pts != AV_NOPTS_VALUE) {
+                end = std::max(end, pts);
+            }
+        }
+        av_packet_unref(&pkt);
+    }
+    avformat_close_input(&fmtCxt);
+    if (_cancel || entries.empty()) return;
+
+    // 乱序封装的文件关键帧时间戳不一定递增, 排好序才能二分查找
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+        return a.pts < b.pts;
+    });
+    _entries.swap(entries);
+    _end = complete ? INT64_MAX : end;
+    _ready = true;
+    qDebug() << "seek index built" << _entries.size() << "key frames" << (complete ? "" : "(partial)");
+
+    writeCache();
+}
+
+bool SeekIndex::readCache() {
+    QFile file(_cachePath);
+    if (!file.open(QIODevice::ReadOnly)) return false;
+
+    QDataStream in(&file);
+    quint32 magic, version, count;
+    qint32 streamIdx, num, den;
+    qint64 end;
+    in >> magic >> version >> streamIdx >> num >> den >> end >> count;
+    if (in.status() != QDataStream::Ok
+            || magic != SEEK_INDEX_MAGIC
+            || version != SEEK_INDEX_VERSION
+            || streamIdx != _streamIdx
+            || num != _timeBase.num
+            || den != _timeBase.den
+            // 每个关键帧占20字节, 数量对不上说明文件损坏
+            || count > file.size() / 20) {
+        return false;
+    }
+
+    std::vector<Entry> entries(count);
+    for (Entry &entry : entries) {
+        qint64 pts, pos;
+        qint32 frames;
+        in >> pts >> pos >> frames;
+        entry.pts = pts;
+        entry.pos = pos;
+        entry.frames = frames;
+    }
+    if (in.status() != QDataStream::Ok || entries.empty()) return false;
+
+    _entries.swap(entries);
+    _end = end;
+    return true;
+}
+
+void SeekIndex::writeCache() {
+    MediaCache::makeDir(_cachePath);
+    // 先写临时文件再替换, 写到一半退出也不会留下损坏的缓存
+    QSaveFile file(_cachePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "seek index cache open error:" << _cachePath;
+        return;
+    }
+
+    QDataStream out(&file);
+    out << (quint32)SEEK_INDEX_MAGIC
+        << (quint32)SEEK_INDEX_VERSION
+        << (qint32)_streamIdx
+        << (qint32)_timeBase.num
+        << (qint32)_timeBase.den
+        << (qint64)_end
+        << (quint32)_entries.size();
+    for (const Entry &entry : _entries) {
+        out << (qint64)entry.pts << (qint64)entry.pos << (qint32)entry.frames;
+    }
+    file.commit();
+}
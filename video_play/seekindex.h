@@ -0,0 +1,71 @@
+#ifndef SEEKINDEX_H
+#define SEEKINDEX_H
+
+#include <QString>
+#include <atomic>
+#include <thread>
+#include <vector>
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+/**
+ * 视频流关键帧索引
+ * 第一次打开文件时在后台线程读一遍视频包, 记录每个关键帧的时间戳、文件位置和GOP长度, 保存到缓存目录.
+ * 之后再打开同一个文件直接读取缓存, seek时直接跳到目标前面最近的关键帧, 不依赖容器自带的索引.
+ * 文件中间有损坏的包就跳过, 实在读不下去时保留已经建好的部分.
+ */
+class SeekIndex
+{
+public:
+    // 关键帧
+    typedef struct {
+        /** 时间戳(流的time_base)*/
+        int64_t pts;
+        /** 在文件中的字节位置, -1说明不知道*/
+        int64_t pos;
+        /** 这个GOP有多少帧(解码顺序, 从关键帧到seek目标最多解码这么多帧)*/
+        int frames;
+    } Entry;
+
+    SeekIndex();
+    ~SeekIndex();
+
+    /** 加载关键帧索引, 没有缓存就开后台线程建立并保存*/
+    void load(const char *filename, int streamIdx, AVRational timeBase);
+    /** 停止后台线程, 清空索引*/
+    void cancel();
+    /** 索引是否可用*/
+    bool isReady();
+    /** 查找时间戳不晚于pts的最后一个关键帧, pts超出索引覆盖的范围返回false*/
+    bool find(int64_t pts, Entry &entry);
+
+private:
+    /** 关键帧列表, 按时间戳递增*/
+    std::vector<Entry> _entries;
+    /** 索引覆盖到的最大时间戳, 读到文件尾部的完整索引是INT64_MAX*/
+    int64_t _end = INT64_MAX;
+    /** 索引建立完毕才能查找*/
+    std::atomic<bool> _ready{false};
+    /** 停止后台建立索引*/
+    std::atomic<bool> _cancel{false};
+    /** 后台建立索引的线程*/
+    std::thread _thread;
+    /** 文件路径*/
+    std::string _filename;
+    /** 视频流索引*/
+    int _streamIdx = -1;
+    /** 视频流时间基*/
+    AVRational _timeBase = {0, 1};
+    /** 缓存文件路径*/
+    QString _cachePath;
+
+    /** 读一遍文件建立索引(后台线程)*/
+    void build();
+    /** 读取缓存文件*/
+    bool readCache();
+    /** 写入缓存文件*/
+    void writeCache();
+};
+
+#endif // SEEKINDEX_H
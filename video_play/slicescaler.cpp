@@ -0,0 +1,276 @@
+#include "slicescaler.h"
+#include "yuv2rgb.h"
+#include <QDebug>
+#include <algorithm>
+extern "C" {
+#include <libavutil/time.h>
+#include <libavutil/opt.h>
+#include <libavutil/imgutils.h>
+}
+
+// 每个条带至少多少行, 再小线程切换的开销就比转换还大了
+#define SLICE_MIN_HEIGHT 256
+// 最多切几个条带
+#define SLICE_MAX_COUNT 8
+
+// FFmpeg 5.0(libswscale 6.4)开始swscale自己支持分条带多线程缩放
+#if LIBSWSCALE_VERSION_INT >= AV_VERSION_INT(6, 4, 100)
+#define SLICE_SCALER_SWS_THREADS 1
+#endif
+
+// 输出内存是外界的, 包装成AVBufferRef时不释放
+static void noFree(void *, uint8_t *) {
+}
+
+SliceScaler::SliceScaler()
+{
+    _src = av_frame_alloc();
+}
+
+SliceScaler::~SliceScaler() {
+    free();
+    av_frame_free(&_src);
+}
+
+int SliceScaler::sliceCount(int srcH, int dstH) {
+    int count = std::max(srcH, dstH) / SLICE_MIN_HEIGHT;
+    int cores = std::thread::hardware_concurrency();
+    if (cores > 0) {
+        count = std::min(count, cores);
+    }
+    return std::max(1, std::min(count, SLICE_MAX_COUNT));
+}
+
+bool SliceScaler::isMatch(int srcW, int srcH, AVPixelFormat srcFmt,
+                          int dstW, int dstH, AVPixelFormat dstFmt, int flags) {
+    return !_slices.empty()
+            && srcW == _srcW && srcH == _srcH && srcFmt == _srcFmt
+            && dstW == _dstW && dstH == _dstH && dstFmt == _dstFmt
+            && (_direct || flags == _flags);
+}
+
+int SliceScaler::init(int srcW, int srcH, AVPixelFormat srcFmt,
+                      int dstW, int dstH, AVPixelFormat dstFmt,
+                      int flags, int slices) {
+    free();
+
+    _direct = srcW == dstW && srcH == dstH
+            && dstFmt == AV_PIX_FMT_RGB32
+            && Yuv2Rgb::isSupported(srcFmt);
+    if (!_direct) {
+        // 缩放时条带边缘的垂直滤波取不到相邻条带的行, 每个条带单独缩放接缝处会有痕迹, 整帧用一个SwsContext
+        int ret = initSws(srcW, srcH, srcFmt, dstW, dstH, dstFmt, flags, slices);
+        if (ret < 0) return ret;
+        slices = 1;
+    }
+
+    // 条带边界要对齐色度平面的行, 比如yuv420p两行亮度共用一行色度
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(srcFmt);
+    if (!desc) return -1;
+    int align = std::max(1 << desc->log2_chroma_h, 2);
+
+    // 按输出的行均分, 再换算到输入的行
+    std::vector<int> srcYs, dstYs;
+    for (int i = 0; i < slices; i++) {
+        int dstY = dstH * i / slices;
+        int srcY = (int64_t)dstY * srcH / dstH;
+        srcYs.push_back(srcY / align * align);
+        dstYs.push_back(srcH == dstH ? srcYs.back() : dstY / 2 * 2);
+    }
+    srcYs.push_back(srcH);
+    dstYs.push_back(dstH);
+
+    for (int i = 0; i < slices; i++) {
+        Slice slice;
+        slice.srcY = srcYs[i];
+        slice.srcH = srcYs[i + 1] - srcYs[i];
+        slice.dstY = dstYs[i];
+        slice.dstH = dstYs[i + 1] - dstYs[i];
+        if (slice.srcH <= 0 || slice.dstH <= 0) continue;
+        _slices.push_back(slice);
+    }
+
+    _srcW = srcW;
+    _srcH = srcH;
+    _srcFmt = srcFmt;
+    _dstW = dstW;
+    _dstH = dstH;
+    _dstFmt = dstFmt;
+    _flags = flags;
+
+    // 每个条带一个工作线程
+    _quit = false;
+    for (size_t i = 0; i < _slices.size(); i++) {
+        _threads.push_back(std::thread([this, i]() {
+            work(i);
+        }));
+    }
+    qDebug() << "slice scaler" << _slices.size() << "slices"
+             << (_direct ? Yuv2Rgb::isaName(Yuv2Rgb::isa()) : "sws");
+    return 0;
+}
+
+int SliceScaler::initSws(int srcW, int srcH, AVPixelFormat srcFmt,
+                         int dstW, int dstH, AVPixelFormat dstFmt,
+                         int flags, int threads) {
+#ifdef SLICE_SCALER_SWS_THREADS
+    // swscale按条带分给自己的线程, 各线程共用同一组滤波系数, 条带之间接得上
+    _swsCxt = sws_alloc_context();
+    if (!_swsCxt) {
+        qDebug() << "sws_alloc_context error";
+        return -1;
+    }
+    av_opt_set_int(_swsCxt, "srcw", srcW, 0);
+    av_opt_set_int(_swsCxt, "srch", srcH, 0);
+    av_opt_set_int(_swsCxt, "src_format", srcFmt, 0);
+    av_opt_set_int(_swsCxt, "dstw", dstW, 0);
+    av_opt_set_int(_swsCxt, "dsth", dstH, 0);
+    av_opt_set_int(_swsCxt, "dst_format", dstFmt, 0);
+    av_opt_set_int(_swsCxt, "sws_flags", flags, 0);
+    av_opt_set_int(_swsCxt, "threads", threads, 0);
+    if (sws_init_context(_swsCxt, nullptr, nullptr) < 0) {
+        qDebug() << "sws_init_context error";
+        free();
+        return -1;
+    }
+    _dstFrame = av_frame_alloc();
+    if (!_dstFrame) {
+        qDebug() << "av_frame_alloc error";
+        free();
+        return -1;
+    }
+    qDebug() << "sws threads" << threads;
+#else
+    // 老版本的swscale不支持多线程, 整帧在一个工作线程上缩放, 仍然和调用线程的工作重叠
+    _swsCxt = sws_getContext(srcW, srcH, srcFmt,
+                             dstW, dstH, dstFmt,
+                             flags, nullptr, nullptr, nullptr);
+    if (!_swsCxt) {
+        qDebug() << "sws_getContext error";
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+void SliceScaler::free() {
+    wait();
+
+    _mutex.lock();
+    _quit = true;
+    _mutex.broadcast();
+    _mutex.unlock();
+    for (std::thread &thread : _threads) {
+        thread.join();
+    }
+    _threads.clear();
+
+    _slices.clear();
+    av_frame_unref(_src);
+    sws_freeContext(_swsCxt);
+    _swsCxt = nullptr;
+    av_frame_free(&_dstFrame);
+}
+
+int SliceScaler::start(const AVFrame *src, uint8_t *const dst[], const int dstLinesize[]) {
+    _mutex.lock();
+    // 上一帧转换完才能换输入输出
+    while (_pending > 0) {
+        _mutex.wait();
+    }
+    // 调用者接着解码会覆盖src, 转换期间自己持有一个引用
+    av_frame_unref(_src);
+    if (!_src || av_frame_ref(_src, src) < 0) {
+        _mutex.unlock();
+        qDebug() << "av_frame_ref error";
+        return -1;
+    }
+    for (int i = 0; i < 4; i++) {
+        _dst[i] = dst[i];
+        _dstLinesize[i] = dstLinesize[i];
+    }
+    _startTime = av_gettime_relative();
+    _pending = (int)_slices.size();
+    _generation++;
+    int generation = _generation;
+    // 唤醒所有工作线程
+    _mutex.broadcast();
+    _mutex.unlock();
+    return generation;
+}
+
+void SliceScaler::wait() {
+    _mutex.lock();
+    while (_pending > 0) {
+        _mutex.wait();
+    }
+    _mutex.unlock();
+}
+
+void SliceScaler::wait(int generation) {
+    _mutex.lock();
+    while (_finished < generation) {
+        _mutex.wait();
+    }
+    _mutex.unlock();
+}
+
+int64_t SliceScaler::lastTime() {
+    return _lastTime;
+}
+
+void SliceScaler::work(int idx) {
+    int generation = 0;
+    while (true) {
+        _mutex.lock();
+        while (!_quit && _generation == generation) {
+            _mutex.wait();
+        }
+        if (_quit) {
+            _mutex.unlock();
+            return;
+        }
+        generation = _generation;
+        _mutex.unlock();
+
+        scaleSlice(_slices[idx]);
+
+        _mutex.lock();
+        // 最后一个完成的条带唤醒等待的线程
+        if (--_pending == 0) {
+            _lastTime = av_gettime_relative() - _startTime;
+            _finished = _generation;
+            _mutex.broadcast();
+        }
+        _mutex.unlock();
+    }
+}
+
+void SliceScaler::scaleSlice(const Slice &slice) {
+    if (_direct) {
+        Yuv2Rgb::convert(_src, slice.srcY, slice.srcH, _dst[0], _dstLinesize[0]);
+        return;
+    }
+
+#ifdef SLICE_SCALER_SWS_THREADS
+    // sws_scale_frame要求输出帧有引用计数, 把外界的内存包装一下, 转换完解除引用不释放内存
+    _dstFrame->format = _dstFmt;
+    _dstFrame->width = _dstW;
+    _dstFrame->height = _dstH;
+    for (int i = 0; i < 4; i++) {
+        _dstFrame->data[i] = _dst[i];
+        _dstFrame->linesize[i] = _dstLinesize[i];
+    }
+    _dstFrame->buf[0] = av_buffer_create(_dst[0], av_image_get_buffer_size(_dstFmt, _dstW, _dstH, 1),
+                                         noFree, nullptr, 0);
+    if (_dstFrame->buf[0]) {
+        sws_scale_frame(_swsCxt, _dstFrame, _src);
+    }
+    av_frame_unref(_dstFrame);
+#else
+    sws_scale(_swsCxt,
+              _src->data, _src->linesize,
+              0, _srcH,
+              _dst, _dstLinesize);
+#endif
+}
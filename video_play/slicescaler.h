@@ -0,0 +1,100 @@
+#ifndef SLICESCALER_H
+#define SLICESCALER_H
+
+#include <vector>
+#include <thread>
+#include "condmutex.h"
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+}
+
+/**
+ * 分条带并行的像素格式转换
+ * 不缩放的常见格式把一帧画面按水平条带切开, 每个工作线程用Yuv2Rgb转换一个条带(逐行转换, 条带之间没有依赖).
+ * 要缩放时垂直滤波会用到相邻的行, 不能切开单独缩放, 整帧交给一个SwsContext, FFmpeg 5.0以上由swscale自己分条带多线程缩放.
+ * start()引用输入帧后立即返回, 转换和调用线程后面的工作(解码下一帧)重叠进行, 同一时刻只转换一帧.
+ * 每一帧有一个序号, 使用输出的线程(显示线程)用wait(序号)等待这一帧转换完成.
+ */
+class SliceScaler
+{
+public:
+    SliceScaler();
+    ~SliceScaler();
+
+    /** 按输入输出大小计算要切几个条带, 小画面返回1(不值得并行)*/
+    static int sliceCount(int srcH, int dstH);
+    /** 配置是否和当前一致, 不一致要重新init*/
+    bool isMatch(int srcW, int srcH, AVPixelFormat srcFmt,
+                 int dstW, int dstH, AVPixelFormat dstFmt, int flags);
+    /** 创建转换上下文和工作线程, flags是sws的缩放算法, slices是条带数(缩放时是swscale的线程数)*/
+    int init(int srcW, int srcH, AVPixelFormat srcFmt,
+             int dstW, int dstH, AVPixelFormat dstFmt,
+             int flags, int slices);
+    /** 停止工作线程, 释放转换上下文*/
+    void free();
+    /**
+     * 开始转换一帧, 立即返回这一帧的序号, 失败返回负数
+     * 上一帧还没转换完先等待; src增加一个引用, 调用者可以接着往src里解码
+     */
+    int start(const AVFrame *src, uint8_t *const dst[], const int dstLinesize[]);
+    /** 等待正在转换的帧完成, 没有在转换直接返回*/
+    void wait();
+    /** 等待序号为generation的帧转换完成*/
+    void wait(int generation);
+    /** 上一帧从start到转换完成用的时间 单位是微妙*/
+    int64_t lastTime();
+
+private:
+    // 一个条带
+    typedef struct {
+        int srcY;
+        int srcH;
+        int dstY;
+        int dstH;
+    } Slice;
+
+    std::vector<Slice> _slices;
+    std::vector<std::thread> _threads;
+    /** 分派任务和等待完成用的锁*/
+    CondMutex _mutex;
+    /** 每开始一帧加1, 工作线程据此判断有没有新任务*/
+    int _generation = 0;
+    /** 最后一个转换完成的帧的序号*/
+    int _finished = 0;
+    /** 还有几个条带没转换完*/
+    int _pending = 0;
+    /** 工作线程退出*/
+    bool _quit = false;
+
+    /** 当前帧的输入(引用调用者的帧)和输出*/
+    AVFrame *_src = nullptr;
+    uint8_t *_dst[4] = {nullptr};
+    int _dstLinesize[4] = {0};
+    /** 当前帧开始转换的时刻*/
+    int64_t _startTime = 0;
+    int64_t _lastTime = 0;
+
+    /** 不缩放且格式支持时用SIMD专用转换, 不创建SwsContext*/
+    bool _direct = false;
+    /** 整帧共用的转换上下文, 只在一个工作线程上调用*/
+    SwsContext *_swsCxt = nullptr;
+    /** 包装输出内存的帧, sws_scale_frame要用*/
+    AVFrame *_dstFrame = nullptr;
+    /** 当前配置*/
+    int _srcW = 0, _srcH = 0, _dstW = 0, _dstH = 0;
+    AVPixelFormat _srcFmt = AV_PIX_FMT_NONE, _dstFmt = AV_PIX_FMT_NONE;
+    int _flags = 0;
+
+    /** 创建整帧缩放的SwsContext, threads是swscale的线程数*/
+    int initSws(int srcW, int srcH, AVPixelFormat srcFmt,
+                int dstW, int dstH, AVPixelFormat dstFmt,
+                int flags, int threads);
+    /** 工作线程*/
+    void work(int idx);
+    /** 转换一个条带*/
+    void scaleSlice(const Slice &slice);
+};
+
+#endif // SLICESCALER_H
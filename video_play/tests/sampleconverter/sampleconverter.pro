@@ -0,0 +1,11 @@
+# SampleConverter每种专用转换和swr_convert对比, 打印转换速度
+include(../tests.pri)
+
+TARGET = tst_sampleconverter
+
+SOURCES += \
+    ../../sampleconverter.cpp \
+    tst_sampleconverter.cpp
+
+HEADERS += \
+    ../../sampleconverter.h
@@ -0,0 +1,217 @@
+#include "sampleconverter.h"
+#include "testutil.h"
+#include <cmath>
+#include <vector>
+extern "C" {
+#include <libavutil/channel_layout.h>
+#include <libswresample/swresample.h>
+}
+
+/**
+ * SampleConverter正确性测试和测速
+ * find()能找到的每种组合, 用随机输入和超出范围的输入, 和swr_convert的结果比较:
+ * float输出相对误差不超过1e-6, s16输出最多差1(swr单声道转立体声用定点的混音矩阵, 舍入可能差1).
+ * 样本数都不是8的倍数, SIMD一次处理8个样本之外总有剩下的尾部.
+ * 最后打印每种组合和swr_convert的转换速度.
+ * 全部通过返回0.
+ */
+
+// 测试的样本数(每个声道)
+static const int TEST_SAMPLES[] = {1, 7, 9, 15, 17, 63, 1023, 1031};
+// s16输出每个样本最多差多少
+#define TEST_MAX_DIFF_S16 1
+// float输出每个样本最多差多少(相对误差, 超出范围的输入不截断, 按数值大小算)
+#define TEST_MAX_DIFF_FLT 1e-6
+// 采样率, 输入输出一样, swr不重采样
+#define TEST_SAMPLE_RATE 48000
+
+// 测速每次转换的样本数(解码出来一帧的常见大小)和次数
+#define BENCH_SAMPLES 1024
+#define BENCH_LOOPS 20000
+
+// 一种转换组合
+typedef struct {
+    AVSampleFormat inFmt;
+    int64_t inLayout;
+    AVSampleFormat outFmt;
+    int64_t outLayout;
+} Case;
+
+static const Case TEST_CASES[] = {
+    {AV_SAMPLE_FMT_FLTP, AV_CH_LAYOUT_STEREO, AV_SAMPLE_FMT_S16, AV_CH_LAYOUT_STEREO},
+    {AV_SAMPLE_FMT_FLTP, AV_CH_LAYOUT_STEREO, AV_SAMPLE_FMT_FLT, AV_CH_LAYOUT_STEREO},
+    {AV_SAMPLE_FMT_S16P, AV_CH_LAYOUT_STEREO, AV_SAMPLE_FMT_S16, AV_CH_LAYOUT_STEREO},
+    {AV_SAMPLE_FMT_S16P, AV_CH_LAYOUT_STEREO, AV_SAMPLE_FMT_FLT, AV_CH_LAYOUT_STEREO},
+    {AV_SAMPLE_FMT_FLTP, AV_CH_LAYOUT_MONO, AV_SAMPLE_FMT_S16, AV_CH_LAYOUT_STEREO},
+    {AV_SAMPLE_FMT_FLTP, AV_CH_LAYOUT_MONO, AV_SAMPLE_FMT_FLT, AV_CH_LAYOUT_STEREO},
+    {AV_SAMPLE_FMT_S16P, AV_CH_LAYOUT_MONO, AV_SAMPLE_FMT_S16, AV_CH_LAYOUT_STEREO},
+    {AV_SAMPLE_FMT_S16, AV_CH_LAYOUT_MONO, AV_SAMPLE_FMT_FLT, AV_CH_LAYOUT_STEREO},
+    // 多声道走C实现
+    {AV_SAMPLE_FMT_FLTP, AV_CH_LAYOUT_5POINT1, AV_SAMPLE_FMT_S16, AV_CH_LAYOUT_5POINT1},
+};
+
+// 输入的取值
+#define INPUT_RANDOM 0 // 范围内随机
+#define INPUT_CLIP 1 // 超出范围, 输出s16时要截断
+
+static QString caseName(const Case &c) {
+    char inLayout[64], outLayout[64];
+    av_get_channel_layout_string(inLayout, sizeof(inLayout), 0, c.inLayout);
+    av_get_channel_layout_string(outLayout, sizeof(outLayout), 0, c.outLayout);
+    return QString("%1 %2 -> %3 %4").arg(QString(av_get_sample_fmt_name(c.inFmt)), QString(inLayout),
+                                         QString(av_get_sample_fmt_name(c.outFmt)), QString(outLayout));
+}
+
+#pragma mark - 测试数据
+// 每个声道一个平面(交错存放的单声道只有一个平面), samples是每个声道的样本数
+class Input
+{
+public:
+    Input(AVSampleFormat fmt, int chs, int samples, int mode) {
+        _planes.resize(chs);
+        for (int ch = 0; ch < chs; ch++) {
+            std::vector<uint8_t> &plane = _planes[ch];
+            plane.resize(samples * av_get_bytes_per_sample(fmt));
+            for (int i = 0; i < samples; i++) {
+                if (av_get_packed_sample_fmt(fmt) == AV_SAMPLE_FMT_S16) {
+                    // s16本身不会超出范围, 两种取值都用整个范围
+                    ((int16_t *)plane.data())[i] = (int16_t)(rand() & 0xffff);
+                }else {
+                    ((float *)plane.data())[i] = sample(i, mode);
+                }
+            }
+            _data.push_back(plane.data());
+        }
+    }
+
+    const uint8_t * const *data() const {
+        return _data.data();
+    }
+
+private:
+    std::vector<std::vector<uint8_t>> _planes;
+    std::vector<const uint8_t *> _data;
+
+    // float样本, 超出范围的输入开头几个是边界附近的值
+    static float sample(int i, int mode) {
+        float r = rand() * 2.0f / RAND_MAX - 1.0f;
+        if (mode == INPUT_RANDOM) return r;
+        static const float EDGES[] = {1.0f, -1.0f, 1.0001f, -1.0001f, 0.99999f, -0.99999f, 1e9f, -1e9f};
+        if (i < (int)(sizeof(EDGES) / sizeof(EDGES[0]))) return EDGES[i];
+        return r * 1.5f;
+    }
+};
+
+#pragma mark - 比较
+static SwrContext *createSwr(const Case &c) {
+    SwrContext *swrCxt = swr_alloc_set_opts(nullptr,
+                                            c.outLayout, c.outFmt, TEST_SAMPLE_RATE,
+                                            c.inLayout, c.inFmt, TEST_SAMPLE_RATE,
+                                            0, nullptr);
+    if (swrCxt && swr_init(swrCxt) < 0) {
+        swr_free(&swrCxt);
+    }
+    return swrCxt;
+}
+
+// 两段交错存放的输出的最大差值, s16按整数比较, float按相对误差比较
+static double maxDiff(const std::vector<uint8_t> &a, const std::vector<uint8_t> &b, AVSampleFormat fmt) {
+    double diff = 0;
+    if (fmt == AV_SAMPLE_FMT_S16) {
+        const int16_t *x = (const int16_t *)a.data();
+        const int16_t *y = (const int16_t *)b.data();
+        for (size_t i = 0; i < a.size() / 2; i++) {
+            diff = std::max(diff, (double)std::abs(x[i] - y[i]));
+        }
+    }else {
+        const float *x = (const float *)a.data();
+        const float *y = (const float *)b.data();
+        for (size_t i = 0; i < a.size() / 4; i++) {
+            diff = std::max(diff, std::fabs((double)x[i] - y[i]) / std::max(1.0, std::fabs((double)y[i])));
+        }
+    }
+    return diff;
+}
+
+// 一种组合、一种样本数、一种输入, 返回失败的次数
+static int testConvert(const Case &c, int samples, int mode) {
+    QString name = caseName(c);
+    SampleConverter::Func func = SampleConverter::find(c.inFmt, c.inLayout, c.outFmt, c.outLayout);
+    SwrContext *swrCxt = createSwr(c);
+    if (!func || !swrCxt) {
+        qDebug().noquote() << "FAIL" << name << (func ? "swr_init error" : "not found");
+        swr_free(&swrCxt);
+        return 1;
+    }
+
+    int inChs = av_get_channel_layout_nb_channels(c.inLayout);
+    int outChs = av_get_channel_layout_nb_channels(c.outLayout);
+    Input input(c.inFmt, inChs, samples, mode);
+    int outSize = samples * outChs * av_get_bytes_per_sample(c.outFmt);
+    std::vector<uint8_t> out(outSize), ref(outSize);
+
+    func(input.data(), out.data(), samples, inChs);
+    uint8_t *refData = ref.data();
+    int ret = swr_convert(swrCxt, &refData, samples, (const uint8_t **)input.data(), samples);
+    swr_free(&swrCxt);
+
+    int failures = 0;
+    double diff = maxDiff(out, ref, c.outFmt);
+    double limit = c.outFmt == AV_SAMPLE_FMT_S16 ? TEST_MAX_DIFF_S16 : TEST_MAX_DIFF_FLT;
+    if (ret != samples || diff > limit) {
+        qDebug().noquote() << "FAIL" << name << "samples" << samples
+                           << (mode == INPUT_CLIP ? "clip" : "random")
+                           << "swr returned" << ret << "max diff" << diff;
+        failures++;
+    }
+    return failures;
+}
+
+#pragma mark - 测速
+static void bench(const Case &c) {
+    QString name = caseName(c);
+    SampleConverter::Func func = SampleConverter::find(c.inFmt, c.inLayout, c.outFmt, c.outLayout);
+    SwrContext *swrCxt = createSwr(c);
+    if (!func || !swrCxt) {
+        swr_free(&swrCxt);
+        return;
+    }
+
+    int inChs = av_get_channel_layout_nb_channels(c.inLayout);
+    int outChs = av_get_channel_layout_nb_channels(c.outLayout);
+    Input input(c.inFmt, inChs, BENCH_SAMPLES, INPUT_RANDOM);
+    std::vector<uint8_t> out(BENCH_SAMPLES * outChs * av_get_bytes_per_sample(c.outFmt));
+    uint8_t *outData = out.data();
+
+    int64_t funcTime = benchTime(BENCH_LOOPS, [&]() {
+        func(input.data(), outData, BENCH_SAMPLES, inChs);
+    });
+    int64_t swrTime = benchTime(BENCH_LOOPS, [&]() {
+        swr_convert(swrCxt, &outData, BENCH_SAMPLES, (const uint8_t **)input.data(), BENCH_SAMPLES);
+    });
+    swr_free(&swrCxt);
+
+    double samples = (double)BENCH_SAMPLES * BENCH_LOOPS;
+    qDebug().noquote() << name << "converter" << benchRate(samples, funcTime, "samples")
+                       << "swr_convert" << benchRate(samples, swrTime, "samples");
+}
+
+int main()
+{
+    qDebug() << "simd" << SampleConverter::isSimd();
+
+    testSeed();
+    int failures = 0;
+    for (const Case &c : TEST_CASES) {
+        for (int samples : TEST_SAMPLES) {
+            failures += testConvert(c, samples, INPUT_RANDOM);
+            failures += testConvert(c, samples, INPUT_CLIP);
+        }
+    }
+
+    for (const Case &c : TEST_CASES) {
+        bench(c);
+    }
+
+    return testResult(failures);
+}
@@ -0,0 +1,21 @@
+# 测试工程共用的配置, 被测的源文件直接用上两级目录里播放器的
+QT       = core
+
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+
+INCLUDEPATH += $$PWD/.. $$PWD
+
+# 测速和结果输出
+HEADERS += $$PWD/testutil.h
+
+macx {
+    FFMPEG_HOME = /usr/local/ffmpeg
+}
+
+INCLUDEPATH += $${FFMPEG_HOME}/include
+
+LIBS += -L$${FFMPEG_HOME}/lib \
+        -lavutil \
+        -lswresample \
+        -lswscale
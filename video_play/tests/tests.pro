@@ -0,0 +1,6 @@
+# 专用转换的正确性测试和测速, 单独编译运行: qmake tests.pro && make && make check
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    sampleconverter \
+    yuv2rgb
@@ -0,0 +1,43 @@
+#ifndef TESTUTIL_H
+#define TESTUTIL_H
+
+#include <QDebug>
+#include <QString>
+#include <algorithm>
+#include <cstdlib>
+extern "C" {
+#include <libavutil/time.h>
+}
+
+/**
+ * 测试工程共用的测速和结果输出
+ */
+
+/** 固定随机数种子, 失败时可以复现*/
+static inline void testSeed() {
+    srand(1);
+}
+
+/** 调用func loops次, 返回用时 单位是微秒*/
+template <typename Func>
+static inline int64_t benchTime(int loops, Func func) {
+    int64_t start = av_gettime_relative();
+    for (int i = 0; i < loops; i++) {
+        func();
+    }
+    return av_gettime_relative() - start;
+}
+
+/** time微秒处理了count个unit, 格式化成每秒多少百万个, 比如"123.4 Mpix/s"*/
+static inline QString benchRate(double count, int64_t time, const char *unit) {
+    // 每微秒的个数就是每秒的百万个数
+    return QString::number(count / std::max(time, (int64_t)1), 'f', 1) + " M" + unit + "/s";
+}
+
+/** 打印测试结果, 返回main的返回值, 全部通过返回0*/
+static inline int testResult(int failures) {
+    qDebug() << (failures ? "FAILED" : "PASSED") << failures << "failures";
+    return failures ? 1 : 0;
+}
+
+#endif // TESTUTIL_H
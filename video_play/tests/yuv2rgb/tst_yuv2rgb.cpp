@@ -0,0 +1,249 @@
+#include "yuv2rgb.h"
+#include "testutil.h"
+#include <cstring>
+#include <vector>
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+}
+
+/**
+ * Yuv2Rgb正确性测试和测速
+ * 每种格式、每个奇数宽度用随机画面, 当前CPU支持的每种指令集的结果和sws_scale比较, 每个通道最多差1;
+ * 再按条带分几次转换, 和整帧转换的结果要完全一样(SliceScaler按条带并行转换).
+ * 最后打印每种指令集和sws_scale(播放器的参数)转换一帧1080p的速度.
+ * 全部通过返回0.
+ */
+
+// 测试的宽度都是奇数, SIMD一次处理的像素之外总有剩下的尾部
+static const int TEST_WIDTHS[] = {1, 3, 7, 15, 17, 31, 33, 63, 65, 127, 641, 1279};
+// 测试的高度, 420两行亮度共用一行色度
+#define TEST_HEIGHT 6
+// 和sws_scale的结果每个通道最多差多少
+#define TEST_MAX_DIFF 1
+
+// 测速的画面大小(宽度是奇数)和帧数
+#define BENCH_WIDTH 1919
+#define BENCH_HEIGHT 1080
+#define BENCH_FRAMES 200
+
+static const AVPixelFormat TEST_FORMATS[] = {
+    AV_PIX_FMT_YUV420P,
+    AV_PIX_FMT_YUVJ420P,
+    AV_PIX_FMT_NV12,
+    AV_PIX_FMT_YUV420P10
+};
+
+#pragma mark - 测试数据
+// 读写一个样本, 10位格式每个样本2字节
+static inline int getSample(const uint8_t *row, int x, bool high) {
+    return high ? ((const uint16_t *)row)[x] : row[x];
+}
+
+static inline void setSample(uint8_t *row, int x, bool high, int value) {
+    if (high) {
+        ((uint16_t *)row)[x] = value;
+    }else {
+        row[x] = value;
+    }
+}
+
+// 随机填满各平面
+static AVFrame *randomFrame(AVPixelFormat fmt, int w, int h) {
+    AVFrame *frame = av_frame_alloc();
+    if (!frame) return nullptr;
+    frame->format = fmt;
+    frame->width = w;
+    frame->height = h;
+    if (av_frame_get_buffer(frame, 0) < 0) {
+        av_frame_free(&frame);
+        return nullptr;
+    }
+
+    bool high = fmt == AV_PIX_FMT_YUV420P10;
+    bool nv12 = fmt == AV_PIX_FMT_NV12;
+    int mask = high ? 1023 : 255;
+    int planes = nv12 ? 2 : 3;
+    for (int i = 0; i < planes; i++) {
+        int rows = i == 0 ? h : (h + 1) / 2;
+        // 亮度w个样本, 色度(w+1)/2个样本, nv12的色度是uv交错的
+        int samples = i == 0 ? w : (w + 1) / 2 * (nv12 ? 2 : 1);
+        for (int y = 0; y < rows; y++) {
+            uint8_t *row = frame->data[i] + y * frame->linesize[i];
+            for (int x = 0; x < samples; x++) {
+                setSample(row, x, high, rand() & mask);
+            }
+        }
+    }
+    return frame;
+}
+
+// 色度按最近邻放大成444(第y行第x列用第y/2行第x/2个色度样本), 和Yuv2Rgb取色度的方式一样
+// sws_scale对420的色度位置和插值不同路径处理不一样, 放大成444后比较的只是颜色转换的系数和舍入
+static AVFrame *nearest444(const AVFrame *src) {
+    AVPixelFormat fmt = (AVPixelFormat)src->format;
+    AVPixelFormat outFmt = AV_PIX_FMT_YUV444P;
+    if (fmt == AV_PIX_FMT_YUVJ420P) outFmt = AV_PIX_FMT_YUVJ444P;
+    if (fmt == AV_PIX_FMT_YUV420P10) outFmt = AV_PIX_FMT_YUV444P10;
+
+    AVFrame *out = av_frame_alloc();
+    if (!out) return nullptr;
+    out->format = outFmt;
+    out->width = src->width;
+    out->height = src->height;
+    if (av_frame_get_buffer(out, 0) < 0) {
+        av_frame_free(&out);
+        return nullptr;
+    }
+
+    bool high = fmt == AV_PIX_FMT_YUV420P10;
+    bool nv12 = fmt == AV_PIX_FMT_NV12;
+    for (int y = 0; y < src->height; y++) {
+        memcpy(out->data[0] + y * out->linesize[0],
+               src->data[0] + y * src->linesize[0],
+               src->width * (high ? 2 : 1));
+        for (int c = 0; c < 2; c++) {
+            uint8_t *dstRow = out->data[1 + c] + y * out->linesize[1 + c];
+            for (int x = 0; x < src->width; x++) {
+                int value;
+                if (nv12) {
+                    value = src->data[1][(y >> 1) * src->linesize[1] + (x >> 1) * 2 + c];
+                }else {
+                    value = getSample(src->data[1 + c] + (y >> 1) * src->linesize[1 + c], x >> 1, high);
+                }
+                setSample(dstRow, x, high, value);
+            }
+        }
+    }
+    return out;
+}
+
+#pragma mark - 比较
+// sws_scale转换成RGB32
+static bool swsConvert(const AVFrame *src, uint8_t *dst, int dstLinesize, int flags) {
+    SwsContext *swsCxt = sws_getContext(src->width, src->height, (AVPixelFormat)src->format,
+                                        src->width, src->height, AV_PIX_FMT_RGB32,
+                                        flags, nullptr, nullptr, nullptr);
+    if (!swsCxt) return false;
+    uint8_t *dsts[4] = {dst, nullptr, nullptr, nullptr};
+    int linesizes[4] = {dstLinesize, 0, 0, 0};
+    sws_scale(swsCxt, src->data, src->linesize, 0, src->height, dsts, linesizes);
+    sws_freeContext(swsCxt);
+    return true;
+}
+
+// 两张RGB32画面R\G\B通道的最大差值(不比较alpha)
+static int maxDiff(const std::vector<uint32_t> &a, const std::vector<uint32_t> &b) {
+    int diff = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        for (int shift = 0; shift < 24; shift += 8) {
+            int d = std::abs((int)((a[i] >> shift) & 0xff) - (int)((b[i] >> shift) & 0xff));
+            if (d > diff) diff = d;
+        }
+    }
+    return diff;
+}
+
+// 一种格式、一个宽度, 每种指令集都测, 返回失败的次数
+static int testConvert(AVPixelFormat fmt, int w) {
+    const char *fmtName = av_get_pix_fmt_name(fmt);
+    AVFrame *src = randomFrame(fmt, w, TEST_HEIGHT);
+    AVFrame *src444 = src ? nearest444(src) : nullptr;
+    std::vector<uint32_t> ref(w * TEST_HEIGHT), out(w * TEST_HEIGHT), bands(w * TEST_HEIGHT);
+    int linesize = w * 4;
+
+    int failures = 0;
+    // 参照: 不缩放时滤波不起作用, 全分辨率色度输出、精确舍入
+    bool ready = src444 && swsConvert(src444, (uint8_t *)ref.data(), linesize,
+                                      SWS_POINT | SWS_ACCURATE_RND | SWS_FULL_CHR_H_INT | SWS_FULL_CHR_H_INP);
+    if (!ready) {
+        qDebug() << "FAIL" << fmtName << "width" << w << "prepare error";
+        failures++;
+    }
+
+    for (int isa = Yuv2Rgb::SSE41; ready && isa <= Yuv2Rgb::isa(); isa++) {
+        const char *isaName = Yuv2Rgb::isaName((Yuv2Rgb::Isa)isa);
+        std::fill(out.begin(), out.end(), 0);
+        if (!Yuv2Rgb::convert(src, 0, TEST_HEIGHT, (uint8_t *)out.data(), linesize, (Yuv2Rgb::Isa)isa)) {
+            qDebug() << "FAIL" << fmtName << "width" << w << isaName << "not supported";
+            failures++;
+            continue;
+        }
+        int diff = maxDiff(ref, out);
+        if (diff > TEST_MAX_DIFF) {
+            qDebug() << "FAIL" << fmtName << "width" << w << isaName << "max diff" << diff;
+            failures++;
+        }
+
+        // 按条带分开转换, 条带从奇数行开始也要和整帧一样
+        std::fill(bands.begin(), bands.end(), 0);
+        Yuv2Rgb::convert(src, 0, 3, (uint8_t *)bands.data(), linesize, (Yuv2Rgb::Isa)isa);
+        Yuv2Rgb::convert(src, 3, 1, (uint8_t *)bands.data(), linesize, (Yuv2Rgb::Isa)isa);
+        Yuv2Rgb::convert(src, 4, TEST_HEIGHT - 4, (uint8_t *)bands.data(), linesize, (Yuv2Rgb::Isa)isa);
+        if (bands != out) {
+            qDebug() << "FAIL" << fmtName << "width" << w << isaName << "bands differ";
+            failures++;
+        }
+    }
+
+    av_frame_free(&src);
+    av_frame_free(&src444);
+    return failures;
+}
+
+#pragma mark - 测速
+static void bench(AVPixelFormat fmt) {
+    const char *fmtName = av_get_pix_fmt_name(fmt);
+    AVFrame *src = randomFrame(fmt, BENCH_WIDTH, BENCH_HEIGHT);
+    if (!src) return;
+    std::vector<uint32_t> out(BENCH_WIDTH * BENCH_HEIGHT);
+    uint8_t *dst = (uint8_t *)out.data();
+    int linesize = BENCH_WIDTH * 4;
+    double pixels = (double)BENCH_WIDTH * BENCH_HEIGHT * BENCH_FRAMES;
+
+    for (int isa = Yuv2Rgb::SSE41; isa <= Yuv2Rgb::isa(); isa++) {
+        int64_t time = benchTime(BENCH_FRAMES, [&]() {
+            Yuv2Rgb::convert(src, 0, BENCH_HEIGHT, dst, linesize, (Yuv2Rgb::Isa)isa);
+        });
+        qDebug().noquote() << fmtName << Yuv2Rgb::isaName((Yuv2Rgb::Isa)isa) << benchRate(pixels, time, "pix");
+    }
+
+    // 和播放器回退时的sws_scale对比
+    SwsContext *swsCxt = sws_getContext(BENCH_WIDTH, BENCH_HEIGHT, fmt,
+                                        BENCH_WIDTH, BENCH_HEIGHT, AV_PIX_FMT_RGB32,
+                                        SWS_BILINEAR, nullptr, nullptr, nullptr);
+    if (swsCxt) {
+        uint8_t *dsts[4] = {dst, nullptr, nullptr, nullptr};
+        int linesizes[4] = {linesize, 0, 0, 0};
+        int64_t time = benchTime(BENCH_FRAMES, [&]() {
+            sws_scale(swsCxt, src->data, src->linesize, 0, BENCH_HEIGHT, dsts, linesizes);
+        });
+        qDebug().noquote() << fmtName << "sws_scale" << benchRate(pixels, time, "pix");
+        sws_freeContext(swsCxt);
+    }
+    av_frame_free(&src);
+}
+
+int main()
+{
+    qDebug() << "cpu isa" << Yuv2Rgb::isaName(Yuv2Rgb::isa());
+    if (Yuv2Rgb::isa() == Yuv2Rgb::None) {
+        qDebug() << "no simd implementation on this cpu, skip";
+        return 0;
+    }
+
+    testSeed();
+    int failures = 0;
+    for (AVPixelFormat fmt : TEST_FORMATS) {
+        for (int w : TEST_WIDTHS) {
+            failures += testConvert(fmt, w);
+        }
+    }
+
+    for (AVPixelFormat fmt : TEST_FORMATS) {
+        bench(fmt);
+    }
+
+    return testResult(failures);
+}
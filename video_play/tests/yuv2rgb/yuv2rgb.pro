@@ -0,0 +1,11 @@
+# Yuv2Rgb每种指令集和sws_scale对比, 打印各指令集的转换速度
+include(../tests.pri)
+
+TARGET = tst_yuv2rgb
+
+SOURCES += \
+    ../../yuv2rgb.cpp \
+    tst_yuv2rgb.cpp
+
+HEADERS += \
+    ../../yuv2rgb.h
@@ -0,0 +1,293 @@
+#include "thumbnailstrip.h"
+#include "mediacache.h"
+#include "probecache.h"
+#include <QDebug>
+#include <QFile>
+#include <QSaveFile>
+#include <QDataStream>
+#include <algorithm>
+#include <functional>
+
+// 缓存文件标识和版本, 格式变化时修改版本号让旧缓存失效
+#define THUMBNAIL_MAGIC 0x54484D42
+#define THUMBNAIL_VERSION 1
+// 一个文件最多多少张缩略图, 长视频按这个放大间隔
+#define THUMBNAIL_MAX_COUNT 500
+// 缩略图最小间隔 单位是秒
+#define THUMBNAIL_MIN_INTERVAL 2
+// 最多几个工作线程, 最多占一半的核, 给播放留足余量
+#define THUMBNAIL_MAX_THREADS 4
+
+// 工作线程: 跑一个函数的QThread, std::thread被Qt接管后设置不了优先级
+class ThumbnailWorker : public QThread
+{
+public:
+    explicit ThumbnailWorker(std::function<void()> func) : _func(func) {}
+
+protected:
+    void run() override {
+        _func();
+    }
+
+private:
+    std::function<void()> _func;
+};
+
+ThumbnailStrip::ThumbnailStrip(QObject *parent) : QObject(parent)
+{
+
+}
+
+ThumbnailStrip::~ThumbnailStrip() {
+    cancel();
+}
+
+void ThumbnailStrip::load(const QString &filename, int64_t duration, int width) {
+    cancel();
+    if (duration <= 0 || width <= 0) return;
+
+    QByteArray name = filename.toUtf8();
+    _filename = name.constData();
+    _cachePath = MediaCache::filePath(name.constData(), "thumbnails", ".thumb");
+    _interval = std::max<int64_t>(THUMBNAIL_MIN_INTERVAL,
+                                  (duration + THUMBNAIL_MAX_COUNT - 1) / THUMBNAIL_MAX_COUNT);
+    _width = std::max(width >> 1 << 1, 2);
+    _mutex.lock();
+    _images.assign(duration / _interval + 1, QImage());
+    _mutex.unlock();
+
+    // 有缓存直接用
+    if (readCache()) {
+        _ready = true;
+        qDebug() << "thumbnails loaded" << _images.size();
+        return;
+    }
+
+    // 没有缓存, 几个后台线程并行生成
+    int cores = QThread::idealThreadCount();
+    _workers = std::max(1, std::min(cores / 2, THUMBNAIL_MAX_THREADS));
+    _cancel = false;
+    _next = 0;
+    _finished = 0;
+    _built = 0;
+    for (int i = 0; i < _workers; i++) {
+        QThread *thread = new ThumbnailWorker([this]() {
+            work();
+        });
+        // 只在CPU空闲时运行, 不影响播放线程
+        thread->start(QThread::IdlePriority);
+        _threads.push_back(thread);
+    }
+}
+
+void ThumbnailStrip::cancel() {
+    _cancel = true;
+    for (QThread *thread : _threads) {
+        thread->wait();
+        delete thread;
+    }
+    _threads.clear();
+    _ready = false;
+    _mutex.lock();
+    _images.clear();
+    _mutex.unlock();
+}
+
+QImage ThumbnailStrip::find(int time) {
+    QImage image;
+    _mutex.lock();
+    if (_interval > 0 && !_images.empty()) {
+        // 取最近的一张
+        int idx = (time + _interval / 2) / _interval;
+        idx = std::max(0, std::min(idx, (int)_images.size() - 1));
+        image = _images[idx];
+    }
+    _mutex.unlock();
+    return image;
+}
+
+bool ThumbnailStrip::isReady() {
+    return _ready;
+}
+
+void ThumbnailStrip::work() {
+    AVFormatContext *fmtCxt = nullptr;
+    AVCodecContext *decodeCxt = nullptr;
+    SwsContext *swsCxt = nullptr;
+    AVFrame *frame = av_frame_alloc();
+    int streamIdx = open(&fmtCxt, &decodeCxt);
+
+    // 生成期间_images的大小不变, 只有load和cancel会改, 它们都先等工作线程结束
+    int count = (int)_images.size();
+    while (streamIdx >= 0 && frame && !_cancel) {
+        int index = _next++;
+        if (index >= count) break;
+
+        QImage image = decode(fmtCxt, streamIdx, decodeCxt, frame, &swsCxt, index * _interval);
+        if (image.isNull()) continue;
+
+        _mutex.lock();
+        _images[index] = image;
+        _mutex.unlock();
+        _built++;
+        emit thumbnailReady(index);
+    }
+
+    sws_freeContext(swsCxt);
+    av_frame_free(&frame);
+    avcodec_free_context(&decodeCxt);
+    avformat_close_input(&fmtCxt);
+
+    // 最后一个结束的线程保存缓存, 有缩略图没生成出来就不保存, 下次打开重新生成
+    if (++_finished == _workers && !_cancel) {
+        if (_built == count) {
+            _ready = true;
+            qDebug() << "thumbnails built" << count;
+            writeCache();
+        }else {
+            qDebug() << "thumbnails built" << _built.load() << "of" << count << "not cached";
+        }
+    }
+}
+
+int ThumbnailStrip::open(AVFormatContext **fmtCxt, AVCodecContext **decodeCxt) {
+    int ret = avformat_open_input(fmtCxt, _filename.c_str(), nullptr, nullptr);
+    if (ret < 0) return ret;
+    // 播放器保存过探测结果就跳过探测
+    if (!ProbeCache::read(_filename.c_str(), *fmtCxt)) {
+        ret = avformat_find_stream_info(*fmtCxt, nullptr);
+        if (ret < 0) return ret;
+    }
+
+    int streamIdx = av_find_best_stream(*fmtCxt, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (streamIdx < 0) return streamIdx;
+    // 只关心视频流, 其他流让解封装直接丢掉
+    for (unsigned int i = 0; i < (*fmtCxt)->nb_streams; i++) {
+        (*fmtCxt)->streams[i]->discard = (int)i == streamIdx ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+    }
+
+    AVStream *stream = (*fmtCxt)->streams[streamIdx];
+    AVCodec *decoder = (AVCodec *)avcodec_find_decoder(stream->codecpar->codec_id);
+    if (!decoder) return -1;
+    *decodeCxt = avcodec_alloc_context3(decoder);
+    if (!*decodeCxt) return -1;
+    ret = avcodec_parameters_to_context(*decodeCxt, stream->codecpar);
+    if (ret < 0) return ret;
+
+    // 几个工作线程已经并行, 解码器单线程; 只解码关键帧, 缩略图看不出环路滤波
+    (*decodeCxt)->thread_count = 1;
+    (*decodeCxt)->skip_frame = AVDISCARD_NONKEY;
+    (*decodeCxt)->skip_loop_filter = AVDISCARD_ALL;
+    (*decodeCxt)->flags2 |= AV_CODEC_FLAG2_FAST;
+    // 解码器支持缩小解码(比如mjpeg)就直接解码出不小于缩略图的小图
+    int lowres = 0;
+    while (lowres < decoder->max_lowres && ((*decodeCxt)->width >> (lowres + 1)) >= _width) {
+        lowres++;
+    }
+    (*decodeCxt)->lowres = lowres;
+
+    ret = avcodec_open2(*decodeCxt, decoder, nullptr);
+    if (ret < 0) return ret;
+    return streamIdx;
+}
+
+QImage ThumbnailStrip::decode(AVFormatContext *fmtCxt, int streamIdx, AVCodecContext *decodeCxt,
+                              AVFrame *frame, SwsContext **swsCxt, int time) {
+    // 时间和播放器的seek一致, 不加流的起始时间
+    AVStream *stream = fmtCxt->streams[streamIdx];
+    int64_t ts = time / av_q2d(stream->time_base);
+    if (av_seek_frame(fmtCxt, streamIdx, ts, AVSEEK_FLAG_BACKWARD) < 0) return QImage();
+    avcodec_flush_buffers(decodeCxt);
+
+    // 只要seek位置的第一个关键帧
+    AVPacket pkt;
+    bool sent = false;
+    while (!_cancel && !sent) {
+        if (av_read_frame(fmtCxt, &pkt) < 0) break;
+        if (pkt.stream_index == streamIdx && (pkt.flags & AV_PKT_FLAG_KEY)) {
+            sent = avcodec_send_packet(decodeCxt, &pkt) >= 0;
+        }
+        av_packet_unref(&pkt);
+    }
+    if (!sent) return QImage();
+
+    // 有帧重排的解码器不会马上输出, 送空包让它把这一帧吐出来, 下一次seek后再flush
+    int ret = avcodec_receive_frame(decodeCxt, frame);
+    if (ret == AVERROR(EAGAIN)) {
+        avcodec_send_packet(decodeCxt, nullptr);
+        ret = avcodec_receive_frame(decodeCxt, frame);
+    }
+    if (ret < 0) return QImage();
+
+    // 按视频宽高比缩小, 缩小倍数大用区域平均, 不会有锯齿
+    int w = _width;
+    int h = std::max((int)((int64_t)w * frame->height / frame->width) >> 1 << 1, 2);
+    *swsCxt = sws_getCachedContext(*swsCxt,
+                                   frame->width, frame->height, (AVPixelFormat)frame->format,
+                                   w, h, AV_PIX_FMT_RGB32,
+                                   SWS_AREA, nullptr, nullptr, nullptr);
+    if (!*swsCxt) {
+        av_frame_unref(frame);
+        return QImage();
+    }
+    QImage image(w, h, QImage::Format_RGB32);
+    uint8_t *dst[4] = {image.bits(), nullptr, nullptr, nullptr};
+    int dstLinesize[4] = {image.bytesPerLine(), 0, 0, 0};
+    sws_scale(*swsCxt, frame->data, frame->linesize, 0, frame->height, dst, dstLinesize);
+    av_frame_unref(frame);
+    return image;
+}
+
+bool ThumbnailStrip::readCache() {
+    QFile file(_cachePath);
+    if (!file.open(QIODevice::ReadOnly)) return false;
+
+    QDataStream in(&file);
+    quint32 magic, version, count;
+    qint32 interval, width;
+    in >> magic >> version >> interval >> width >> count;
+    if (in.status() != QDataStream::Ok
+            || magic != THUMBNAIL_MAGIC
+            || version != THUMBNAIL_VERSION
+            || interval != _interval
+            || width != _width
+            || count != _images.size()) {
+        return false;
+    }
+
+    std::vector<QImage> images(count);
+    for (QImage &image : images) {
+        in >> image;
+    }
+    if (in.status() != QDataStream::Ok) return false;
+
+    _mutex.lock();
+    _images.swap(images);
+    _mutex.unlock();
+    return true;
+}
+
+void ThumbnailStrip::writeCache() {
+    MediaCache::makeDir(_cachePath);
+    // 先写临时文件再替换, 写到一半退出也不会留下损坏的缓存
+    QSaveFile file(_cachePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "thumbnail cache open error:" << _cachePath;
+        return;
+    }
+
+    QDataStream out(&file);
+    out << (quint32)THUMBNAIL_MAGIC
+        << (quint32)THUMBNAIL_VERSION
+        << (qint32)_interval
+        << (qint32)_width;
+    // QImage是隐式共享的, 拷贝一份再编码, 不阻塞界面线程取缩略图
+    _mutex.lock();
+    std::vector<QImage> images = _images;
+    _mutex.unlock();
+    out << (quint32)images.size();
+    for (const QImage &image : images) {
+        out << image;
+    }
+    file.commit();
+}
@@ -0,0 +1,80 @@
+#ifndef THUMBNAILSTRIP_H
+#define THUMBNAILSTRIP_H
+
+#include <QObject>
+#include <QImage>
+#include <QString>
+#include <QThread>
+#include <atomic>
+#include <vector>
+#include "condmutex.h"
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+}
+
+/**
+ * 进度条悬停预览用的缩略图条
+ * 每隔固定时间取一张关键帧缩略图. 几个后台线程各自打开解封装和解码器(和播放器互不影响), 分头seek解码,
+ * 线程优先级最低, 解码器单线程、只解码关键帧、能在解码器里缩小就在解码器里缩小.
+ * 生成完保存到缓存目录, 之后再打开同一个文件直接读取.
+ */
+class ThumbnailStrip : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ThumbnailStrip(QObject *parent = nullptr);
+    ~ThumbnailStrip();
+
+    /** 开始生成缩略图, duration是文件时长(秒), width是缩略图宽度(像素), 有缓存直接读取*/
+    void load(const QString &filename, int64_t duration, int width);
+    /** 停止生成, 清空缩略图*/
+    void cancel();
+    /** time秒处的缩略图, 还没生成返回空图片*/
+    QImage find(int time);
+    /** 是否全部生成完(每一张都生成成功)*/
+    bool isReady();
+
+signals:
+    /** 生成了一张缩略图(在工作线程发出)*/
+    void thumbnailReady(int index);
+
+private:
+    /** 缩略图, 没生成的是空图片*/
+    std::vector<QImage> _images;
+    /** 保护_images*/
+    CondMutex _mutex;
+    /** 工作线程, 用QThread才能设置最低优先级*/
+    std::vector<QThread *> _threads;
+    /** 下一张要生成的缩略图索引, 工作线程抢着取*/
+    std::atomic<int> _next{0};
+    /** 工作线程数*/
+    int _workers = 0;
+    /** 已经结束的工作线程数, 最后一个结束的保存缓存*/
+    std::atomic<int> _finished{0};
+    /** 生成成功的缩略图数, 全部成功才保存缓存*/
+    std::atomic<int> _built{0};
+    std::atomic<bool> _ready{false};
+    std::atomic<bool> _cancel{false};
+    /** 文件路径*/
+    std::string _filename;
+    /** 缓存文件路径*/
+    QString _cachePath;
+    /** 每隔几秒一张*/
+    int _interval = 0;
+    /** 缩略图宽度*/
+    int _width = 0;
+
+    /** 工作线程: 打开自己的解封装和解码器, 循环取索引生成缩略图*/
+    void work();
+    /** 打开文件和视频解码器, 返回视频流索引*/
+    int open(AVFormatContext **fmtCxt, AVCodecContext **decodeCxt);
+    /** seek到time秒前面的关键帧, 解码并缩小成缩略图*/
+    QImage decode(AVFormatContext *fmtCxt, int streamIdx, AVCodecContext *decodeCxt,
+                  AVFrame *frame, SwsContext **swsCxt, int time);
+    bool readCache();
+    void writeCache();
+};
+
+#endif // THUMBNAILSTRIP_H
@@ -0,0 +1,161 @@
+#include "timestretch.h"
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+
+// 窗口长度 单位是毫秒, 太短低音不连贯, 太长会有回声
+#define TIME_STRETCH_FRAME_MS 40
+// 找对齐位置的搜索范围(名义位置前后各多少) 单位是毫秒, 要比低音的一个周期长
+#define TIME_STRETCH_SEARCH_MS 10
+// 算相似度时隔几个样本取一个, 够判断波形对齐
+#define TIME_STRETCH_CORR_STEP 4
+
+#pragma mark - 格式转换
+// 交错存放的声卡格式和float互相转换
+static void toFloat(const uint8_t *data, AVSampleFormat fmt, float *dst, int count) {
+    for (int i = 0; i < count; i++) {
+        switch (fmt) {
+        case AV_SAMPLE_FMT_U8: dst[i] = (data[i] - 128) * (1.0f / (1 << 7)); break;
+        case AV_SAMPLE_FMT_S16: dst[i] = ((const int16_t *)data)[i] * (1.0f / (1 << 15)); break;
+        case AV_SAMPLE_FMT_S32: dst[i] = ((const int32_t *)data)[i] * (1.0f / (1U << 31)); break;
+        default: dst[i] = ((const float *)data)[i]; break;
+        }
+    }
+}
+
+static void fromFloat(const float *src, AVSampleFormat fmt, uint8_t *data, int count) {
+    for (int i = 0; i < count; i++) {
+        float x = std::max(-1.0f, std::min(src[i], 1.0f));
+        switch (fmt) {
+        case AV_SAMPLE_FMT_U8: data[i] = (uint8_t)std::min(lrintf(x * (1 << 7)) + 128, 255L); break;
+        case AV_SAMPLE_FMT_S16: ((int16_t *)data)[i] = (int16_t)std::min(lrintf(x * (1 << 15)), 32767L); break;
+        case AV_SAMPLE_FMT_S32: ((int32_t *)data)[i] = (int32_t)std::min(llrint(x * 2147483648.0), 2147483647LL); break;
+        default: ((float *)data)[i] = x; break;
+        }
+    }
+}
+
+#pragma mark - 公有方法
+void TimeStretch::init(AVSampleFormat fmt, int chs, int sampleRate) {
+    _fmt = fmt;
+    _chs = chs;
+    _sampleRate = sampleRate;
+    _frameLen = sampleRate * TIME_STRETCH_FRAME_MS / 1000 / 2 * 2;
+    _hop = _frameLen / 2;
+    _search = sampleRate * TIME_STRETCH_SEARCH_MS / 1000;
+
+    // 周期汉宁窗, 错开半个窗口相加正好是1, 重叠处音量不变
+    _window.resize(_frameLen);
+    for (int i = 0; i < _frameLen; i++) {
+        _window[i] = 0.5f - 0.5f * cosf(2 * (float)M_PI * i / _frameLen);
+    }
+    _overlap.resize(_hop * _chs);
+    reset();
+}
+
+void TimeStretch::reset() {
+    _in.clear();
+    _inPos = 0;
+    _target = -1;
+    std::fill(_overlap.begin(), _overlap.end(), 0.0f);
+}
+
+int TimeStretch::process(const uint8_t *data, int size, double speed, const uint8_t **out) {
+    int bytesPerSample = av_get_bytes_per_sample(_fmt);
+    int count = size / bytesPerSample / _chs * _chs;
+    size_t old = _in.size();
+    _in.resize(old + count);
+    toFloat(data, _fmt, _in.data() + old, count);
+
+    // 输入够一个窗口加上搜索范围就输出一段(窗口的一半)
+    _outFloat.clear();
+    int inFrames = (int)(_in.size() / _chs);
+    while ((int)_inPos + _search + _frameLen <= inFrames) {
+        int nominal = (int)_inPos;
+        // 第一段没有可以对齐的, 直接用名义位置
+        int pos = _target < 0 ? nominal : bestPos(nominal);
+        const float *frame = _in.data() + pos * _chs;
+
+        // 前一半和上一段的后一半相加后输出, 后一半留给下一段
+        size_t o = _outFloat.size();
+        _outFloat.resize(o + _hop * _chs);
+        for (int i = 0; i < _hop; i++) {
+            for (int ch = 0; ch < _chs; ch++) {
+                int idx = i * _chs + ch;
+                _outFloat[o + idx] = _overlap[idx] + frame[idx] * _window[i];
+                _overlap[idx] = frame[_hop * _chs + idx] * _window[_hop + i];
+            }
+        }
+        _target = pos + _hop;
+        // 名义位置按速度前进: 快放跳过一部分输入, 慢放重复一部分输入
+        _inPos += _hop * speed;
+    }
+
+    // 丢掉以后不会再用到的输入: 下一次最早从名义位置往前一个搜索范围开始, 以及上一段按原速接下去的一段
+    int drop = (int)_inPos - _search;
+    if (_target >= 0) {
+        drop = std::min(drop, _target);
+    }
+    if (drop > 0) {
+        _in.erase(_in.begin(), _in.begin() + drop * _chs);
+        _inPos -= drop;
+        if (_target >= 0) _target -= drop;
+    }
+
+    _out.resize(_outFloat.size() * bytesPerSample);
+    fromFloat(_outFloat.data(), _fmt, _out.data(), (int)_outFloat.size());
+    *out = _out.data();
+    return (int)_out.size();
+}
+
+double TimeStretch::pending() {
+    if (_sampleRate <= 0) return 0;
+    // 已经输出到上一段窗口的前一半末尾
+    int inFrames = (int)(_in.size() / _chs);
+    int consumed = std::max(_target, 0);
+    return std::max(inFrames - consumed, 0) * 1.0 / _sampleRate;
+}
+
+#pragma mark - 私有方法
+int TimeStretch::bestPos(int nominal) {
+    // 上一段窗口按原速接下去的一段作为参照, 找和它最像的位置, 接起来波形连续
+    const float *target = _in.data() + _target * _chs;
+    int begin = std::max(0, nominal - _search);
+    int end = nominal + _search;
+
+    // 归一化的相关, 不偏向音量大的位置; 声道加起来比较
+    auto score = [&](int k) {
+        const float *cand = _in.data() + k * _chs;
+        float dot = 0, energy = 0;
+        for (int i = 0; i < _hop; i += TIME_STRETCH_CORR_STEP) {
+            float c = 0, t = 0;
+            for (int ch = 0; ch < _chs; ch++) {
+                c += cand[i * _chs + ch];
+                t += target[i * _chs + ch];
+            }
+            dot += c * t;
+            energy += c * c;
+        }
+        return dot / sqrtf(energy + 1e-9f);
+    };
+
+    // 先隔一个位置粗找, 再在附近细找
+    int best = nominal;
+    float bestScore = -FLT_MAX;
+    for (int k = begin; k <= end; k += 2) {
+        float s = score(k);
+        if (s > bestScore) {
+            bestScore = s;
+            best = k;
+        }
+    }
+    int coarse = best;
+    for (int k = std::max(begin, coarse - 1); k <= std::min(end, coarse + 1); k++) {
+        float s = score(k);
+        if (s > bestScore) {
+            bestScore = s;
+            best = k;
+        }
+    }
+    return best;
+}
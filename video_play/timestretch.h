@@ -0,0 +1,56 @@
+#ifndef TIMESTRETCH_H
+#define TIMESTRETCH_H
+
+#include <cstdint>
+#include <vector>
+extern "C" {
+#include <libavutil/samplefmt.h>
+}
+
+/**
+ * 变速不变调(WSOLA)
+ * 输入按速度跳着取一段段窗口(快放跳过、慢放重复), 每段在搜索范围内找和上一段接得最像的位置, 再用汉宁窗重叠相加,
+ * 输出的每一段时长不变, 所以音调不变. 内部按float处理, 输入输出是交错存放的声卡格式(u8\s16\s32\flt).
+ */
+class TimeStretch
+{
+public:
+    /** 设置格式(交错存放), 采样率决定窗口和搜索范围的长度*/
+    void init(AVSampleFormat fmt, int chs, int sampleRate);
+    /** 清掉缓存的输入和还没输出的重叠部分(seek、回到1倍速时调用)*/
+    void reset();
+    /**
+     * 放入一段PCM按speed变速, *out指向输出(下次调用前有效), 返回输出的字节数
+     * 输入不够一个窗口时先缓存起来, 返回0
+     */
+    int process(const uint8_t *data, int size, double speed, const uint8_t **out);
+    /** 已经放入但还没变成输出的输入时长 单位是秒, 用来推算输出的时间戳*/
+    double pending();
+
+private:
+    AVSampleFormat _fmt = AV_SAMPLE_FMT_NONE;
+    int _chs = 0;
+    int _sampleRate = 0;
+    /** 窗口长度、输出步长(窗口的一半)、搜索范围 单位是样本帧*/
+    int _frameLen = 0;
+    int _hop = 0;
+    int _search = 0;
+    /** 汉宁窗, 重叠一半时相加为1*/
+    std::vector<float> _window;
+    /** 缓存的输入(交错存放)*/
+    std::vector<float> _in;
+    /** 下一段窗口的名义位置(按速度前进), 相对_in的开头*/
+    double _inPos = 0;
+    /** 上一段窗口按原速接下去的位置(选中的位置加上输出步长), 下一段要和这里对齐, -1是还没有*/
+    int _target = -1;
+    /** 上一段窗口后一半, 和下一段窗口前一半相加后输出*/
+    std::vector<float> _overlap;
+    /** 输出*/
+    std::vector<float> _outFloat;
+    std::vector<uint8_t> _out;
+
+    /** 在名义位置附近找和上一段接得最像的位置*/
+    int bestPos(int nominal);
+};
+
+#endif // TIMESTRETCH_H
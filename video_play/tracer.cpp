@@ -0,0 +1,190 @@
+#include "tracer.h"
+#include "condmutex.h"
+#include <QDebug>
+#include <QSaveFile>
+#include <QByteArray>
+#include <vector>
+#include <cstdio>
+extern "C" {
+#include <libavutil/time.h>
+}
+
+namespace {
+
+// 一个事件
+typedef struct {
+    const char *name;
+    /** Chrome trace的事件类型: B开始, E结束, i时刻, C计数*/
+    char phase;
+    /** 时刻 单位是微妙*/
+    int64_t ts;
+    /** pts或者计数值*/
+    double value;
+} TraceEvent;
+
+// 一个线程的环形缓冲, 只有所属线程写, 导出时其他线程读
+typedef struct TraceBuffer {
+    TraceEvent events[TRACE_BUFFER_CAPACITY];
+    /** 一共写了多少个事件, 写完事件再增加*/
+    std::atomic<uint64_t> head{0};
+    /** 线程编号, 导出时作为tid*/
+    int tid = 0;
+    std::atomic<const char *> name{nullptr};
+    /** 所属线程还在运行, 线程结束后缓冲留给之后新建的线程复用*/
+    std::atomic<bool> inUse{false};
+} TraceBuffer;
+
+// 所有线程的缓冲, 只在线程第一次记录和导出时加锁
+CondMutex &registryMutex() {
+    static CondMutex mutex;
+    return mutex;
+}
+std::vector<TraceBuffer *> &registry() {
+    static std::vector<TraceBuffer *> buffers;
+    return buffers;
+}
+
+// 线程结束时把缓冲标记为空闲
+struct ThreadBuffer {
+    TraceBuffer *buffer = nullptr;
+    ~ThreadBuffer() {
+        if (buffer) buffer->inUse = false;
+    }
+};
+thread_local ThreadBuffer threadBuffer;
+
+TraceBuffer *currentBuffer() {
+    if (threadBuffer.buffer) return threadBuffer.buffer;
+
+    // 优先复用已经结束的线程的缓冲, 播放器每次播放都会新建线程, 缓冲数量不会一直增长
+    CondMutex &mutex = registryMutex();
+    mutex.lock();
+    TraceBuffer *buffer = nullptr;
+    for (TraceBuffer *b : registry()) {
+        if (!b->inUse) {
+            buffer = b;
+            break;
+        }
+    }
+    if (!buffer) {
+        buffer = new TraceBuffer();
+        registry().push_back(buffer);
+    }
+    static int nextTid = 1;
+    buffer->tid = nextTid++;
+    buffer->name = nullptr;
+    buffer->head = 0;
+    buffer->inUse = true;
+    mutex.unlock();
+
+    threadBuffer.buffer = buffer;
+    return buffer;
+}
+
+void record(const char *name, char phase, double value) {
+    TraceBuffer *buffer = currentBuffer();
+    uint64_t head = buffer->head.load(std::memory_order_relaxed);
+    TraceEvent &event = buffer->events[head % TRACE_BUFFER_CAPACITY];
+    event.name = name;
+    event.phase = phase;
+    event.ts = av_gettime_relative();
+    event.value = value;
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+void appendEvent(QByteArray &json, const TraceEvent &event, int tid) {
+    char line[256];
+    if (event.phase == 'C') {
+        snprintf(line, sizeof(line),
+                 ",\n{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%lld,\"pid\":1,\"tid\":%d,\"args\":{\"value\":%g}}",
+                 event.name, (long long)event.ts, tid, event.value);
+    }else if (event.value >= 0) {
+        snprintf(line, sizeof(line),
+                 ",\n{\"name\":\"%s\",\"ph\":\"%c\",%s\"ts\":%lld,\"pid\":1,\"tid\":%d,\"args\":{\"pts\":%.3f}}",
+                 event.name, event.phase, event.phase == 'i' ? "\"s\":\"t\"," : "",
+                 (long long)event.ts, tid, event.value);
+    }else {
+        snprintf(line, sizeof(line),
+                 ",\n{\"name\":\"%s\",\"ph\":\"%c\",%s\"ts\":%lld,\"pid\":1,\"tid\":%d}",
+                 event.name, event.phase, event.phase == 'i' ? "\"s\":\"t\"," : "",
+                 (long long)event.ts, tid);
+    }
+    json.append(line);
+}
+
+}
+
+void Tracer::setThreadName(const char *name) {
+    currentBuffer()->name = name;
+}
+
+void Tracer::begin(const char *name, double pts) {
+    record(name, 'B', pts);
+}
+
+void Tracer::end(const char *name, double pts) {
+    record(name, 'E', pts);
+}
+
+void Tracer::instant(const char *name, double pts) {
+    record(name, 'i', pts);
+}
+
+void Tracer::counter(const char *name, double value) {
+    record(name, 'C', value);
+}
+
+bool Tracer::flush(const QString &path) {
+    QByteArray json("{\"traceEvents\":[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"video_play\"}}");
+
+    CondMutex &mutex = registryMutex();
+    mutex.lock();
+    std::vector<TraceEvent> events;
+    for (TraceBuffer *buffer : registry()) {
+        const char *name = buffer->name;
+        if (name) {
+            char line[128];
+            snprintf(line, sizeof(line),
+                     ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                     buffer->tid, name);
+            json.append(line);
+        }
+
+        // 不停下写事件的线程, 拷贝完再看一次写位置, 拷贝期间可能被覆盖的事件丢掉
+        uint64_t head = buffer->head.load(std::memory_order_acquire);
+        uint64_t start = head > TRACE_BUFFER_CAPACITY ? head - TRACE_BUFFER_CAPACITY : 0;
+        events.clear();
+        for (uint64_t i = start; i < head; i++) {
+            events.push_back(buffer->events[i % TRACE_BUFFER_CAPACITY]);
+        }
+        uint64_t newHead = buffer->head.load(std::memory_order_acquire);
+        uint64_t valid = newHead >= TRACE_BUFFER_CAPACITY ? newHead - TRACE_BUFFER_CAPACITY + 1 : 0;
+        for (uint64_t i = start; i < head; i++) {
+            if (i < valid) continue;
+            appendEvent(json, events[i - start], buffer->tid);
+        }
+    }
+    mutex.unlock();
+    json.append("\n]}\n");
+
+    // 先写临时文件再替换, 写到一半退出也不会留下损坏的文件
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "trace file open error:" << path;
+        return false;
+    }
+    file.write(json);
+    bool ok = file.commit();
+    qDebug() << "trace written:" << path;
+    return ok;
+}
+
+Tracer::Scope::Scope(const char *name, double pts)
+    : _name(name)
+{
+    Tracer::begin(name, pts);
+}
+
+Tracer::Scope::~Scope() {
+    Tracer::end(_name);
+}
@@ -0,0 +1,63 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <QString>
+#include <atomic>
+#include <cstdint>
+
+// 每个线程的事件环形缓冲能存多少个事件, 满了覆盖最早的
+#define TRACE_BUFFER_CAPACITY (16 * 1024)
+
+/**
+ * 事件追踪
+ * 每个线程各自一个环形缓冲, 记录事件只写自己的缓冲, 不加锁.
+ * 导出成Chrome trace格式的json, 用chrome://tracing或者Perfetto打开, 可以看到各个线程在什么时刻做什么.
+ * 事件名和线程名必须是字符串常量, 只保存指针.
+ * 通过下面的TRACE_宏调用, 没有定义VIDEO_TRACE时宏是空的, 不影响性能(debug版本默认定义).
+ */
+class Tracer
+{
+public:
+    /** 设置当前线程的名称*/
+    static void setThreadName(const char *name);
+    /** 开始一段耗时, pts是相关的画面\音频时间 单位是秒, 没有传负数*/
+    static void begin(const char *name, double pts = -1);
+    /** 结束一段耗时, 和begin成对调用*/
+    static void end(const char *name, double pts = -1);
+    /** 一个时刻的事件, 比如seek、丢帧*/
+    static void instant(const char *name, double pts = -1);
+    /** 计数值, 比如队列深度、音画偏差*/
+    static void counter(const char *name, double value);
+    /** 把所有线程缓冲里的事件写到文件, 不影响继续记录*/
+    static bool flush(const QString &path);
+
+    /** 作用域内的一段耗时*/
+    class Scope
+    {
+    public:
+        Scope(const char *name, double pts = -1);
+        ~Scope();
+    private:
+        const char *_name;
+    };
+};
+
+#ifdef VIDEO_TRACE
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_THREAD(name) Tracer::setThreadName(name)
+#define TRACE_BEGIN(name, pts) Tracer::begin(name, pts)
+#define TRACE_END(name, pts) Tracer::end(name, pts)
+#define TRACE_SCOPE(name, pts) Tracer::Scope TRACE_CONCAT(_traceScope, __LINE__)(name, pts)
+#define TRACE_INSTANT(name, pts) Tracer::instant(name, pts)
+#define TRACE_COUNTER(name, value) Tracer::counter(name, value)
+#else
+#define TRACE_THREAD(name) do {} while (0)
+#define TRACE_BEGIN(name, pts) do {} while (0)
+#define TRACE_END(name, pts) do {} while (0)
+#define TRACE_SCOPE(name, pts) do {} while (0)
+#define TRACE_INSTANT(name, pts) do {} while (0)
+#define TRACE_COUNTER(name, value) do {} while (0)
+#endif
+
+#endif // TRACER_H
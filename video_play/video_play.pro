@@ -8,22 +8,62 @@ CONFIG += c++11
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+# debug版本编译事件追踪点(TRACE_宏), release版本追踪点是空的
+CONFIG(debug, debug|release): DEFINES += VIDEO_TRACE
+
 SOURCES += \
     condmutex.cpp \
+    degradecontroller.cpp \
+    framemailbox.cpp \
+    framequeue.cpp \
+    latencyhistogram.cpp \
     main.cpp \
     mainwindow.cpp \
+    masterclock.cpp \
+    mediacache.cpp \
+    mediasink.cpp \
+    mmapio.cpp \
+    pcmring.cpp \
+    pktqueue.cpp \
+    probecache.cpp \
+    sampleconverter.cpp \
+    seekindex.cpp \
+    slicescaler.cpp \
+    thumbnailstrip.cpp \
+    timestretch.cpp \
+    tracer.cpp \
     videoplayer.cpp \
     videoplayer_audio.cpp \
+    videoplayer_playlist.cpp \
     videoplayer_video.cpp \
     videoslider.cpp \
-    videowidget.cpp
+    videowidget.cpp \
+    yuv2rgb.cpp
 
 HEADERS += \
     condmutex.h \
+    degradecontroller.h \
+    framemailbox.h \
+    framequeue.h \
+    latencyhistogram.h \
     mainwindow.h \
+    masterclock.h \
+    mediacache.h \
+    mediasink.h \
+    mmapio.h \
+    pcmring.h \
+    pktqueue.h \
+    probecache.h \
+    sampleconverter.h \
+    seekindex.h \
+    slicescaler.h \
+    thumbnailstrip.h \
+    timestretch.h \
+    tracer.h \
     videoplayer.h \
     videoslider.h \
-    videowidget.h
+    videowidget.h \
+    yuv2rgb.h
 
 FORMS += \
     mainwindow.ui
@@ -3,8 +3,21 @@
 #include <QThread>
 #include <QDebug>
 
-#define AUDIO_MAX_PKT_SIZE 1000
-#define VIDEO_MAX_PKT_SIZE 500
+// 包队列上限: 槽位数, 字节数, 缓存时长(微妙)
+// 按字节和时长限制, 高码率4K文件内存占用也是可预期的
+#define AUDIO_PKT_QUEUE_CAPACITY 1024
+#define AUDIO_PKT_QUEUE_MAX_BYTES (2 * 1024 * 1024)
+#define AUDIO_PKT_QUEUE_MAX_DURATION (5 * AV_TIME_BASE)
+#define VIDEO_PKT_QUEUE_CAPACITY 1024
+#define VIDEO_PKT_QUEUE_MAX_BYTES (64 * 1024 * 1024)
+#define VIDEO_PKT_QUEUE_MAX_DURATION (5 * AV_TIME_BASE)
+// 画面队列上限: 槽位数, 字节数
+// 解码提前几帧吸收GOP里的解码耗时波动, 4K画面按字节数限制在几帧
+#define VIDEO_FRAME_QUEUE_CAPACITY 8
+#define VIDEO_FRAME_QUEUE_MAX_BYTES (128 * 1024 * 1024)
+// 播放速度范围
+#define PLAYBACK_SPEED_MIN 0.25
+#define PLAYBACK_SPEED_MAX 4.0
 
 /**
  * 负责预处理视频数据(解封装\编解码流数据)
@@ -13,17 +26,37 @@
 VideoPlayer::VideoPlayer(QObject *parent) : QObject(parent)
 {
     // 初始化SDL
+    // 没有声卡的机器上会失败, 之后打开音频设备也会失败, 只播放画面; 无界面模式不需要声卡
     if (SDL_Init(SDL_INIT_AUDIO)) {
         qDebug() << "sdl init error: " << SDL_GetError();
-        return;
     }
 
-    // 创建音视频包列表
-    _aPktList = new std::list<AVPacket>();
-    _vPktList = new std::list<AVPacket>();
-    // 创建音视频包列表锁
-    _aMutex = new CondMutex();
-    _vMutex = new CondMutex();
+    // 创建状态锁
+    _stateMutex = new CondMutex();
+    // 创建音视频包队列
+    _aPktQueue = new PktQueue(AUDIO_PKT_QUEUE_CAPACITY,
+                              AUDIO_PKT_QUEUE_MAX_BYTES,
+                              AUDIO_PKT_QUEUE_MAX_DURATION);
+    _vPktQueue = new PktQueue(VIDEO_PKT_QUEUE_CAPACITY,
+                              VIDEO_PKT_QUEUE_MAX_BYTES,
+                              VIDEO_PKT_QUEUE_MAX_DURATION);
+    // 创建画面队列
+    _vFrameQueue = new FrameQueue(VIDEO_FRAME_QUEUE_CAPACITY,
+                                  VIDEO_FRAME_QUEUE_MAX_BYTES);
+    // 创建画面信箱
+    _vMailbox = new FrameMailbox();
+    // 创建关键帧索引
+    _vSeekIndex = new SeekIndex();
+    // 创建分条带像素格式转换
+    _vScaler = new SliceScaler();
+    // 创建外部时钟
+    _extClock = new MasterClock();
+    // 创建音频时钟
+    _aClock = new MasterClock();
+    // 创建音频变速
+    _aStretch = new TimeStretch();
+    // 创建视频降级控制
+    _vDegrade = new DegradeController(DegradeKeyFrameOnly);
 
 }
 VideoPlayer::~VideoPlayer()
@@ -32,10 +65,17 @@ VideoPlayer::~VideoPlayer()
     disconnect();
     stop();
 
-    delete  _aPktList;
-    delete  _vPktList;
-    delete  _aMutex;
-    delete  _vMutex;
+    delete  _aPktQueue;
+    delete  _vPktQueue;
+    delete  _vFrameQueue;
+    delete  _vMailbox;
+    delete  _stateMutex;
+    delete  _vSeekIndex;
+    delete  _vScaler;
+    delete  _vDegrade;
+    delete  _extClock;
+    delete  _aClock;
+    delete  _aStretch;
     SDL_Quit();
 }
 #pragma mark - 公有方法
@@ -43,11 +83,21 @@ void VideoPlayer::play() {
     if (_state == Playing) return;
 
     if (_state == Stopped) {
-        std::thread([this]() {
-            readFile();
+        // 记录开始时间, 统计显示第一帧画面的耗时
+        _openTime = av_gettime_relative();
+        _firstFrameTime = -1;
+        resetThroughput();
+        resetPlaybackStats();
+        int session = ++_playSession;
+        std::thread([this, session]() {
+            readFile(session);
         }).detach();
     }else {
         setState(Playing);
+        // 恢复音频播放, 无界面模式的音频解码线程由状态唤醒
+        if (_hasAudio && !_sink) {
+            SDL_PauseAudioDevice(_aDevice, 0);
+        }
     }
 
 }
@@ -61,6 +111,15 @@ void VideoPlayer::stop() {
     if (_state == Stopped) return;
 
     setState(Stopped);
+    // 读文件线程可能正挂起等待队列空位, 唤醒它退出
+    _aPktQueue->wakeup();
+    _vPktQueue->wakeup();
+    // 视频解码线程可能正挂起等待画面队列空位
+    _vFrameQueue->wakeup();
+    // 音频解码线程可能正挂起等待环形缓冲空位
+    if (_aRing) {
+        _aRing->wakeup();
+    }
     // 释放资源,
     free();
     // 多线程下, 一种方法: 延迟等待其他线程走完一圈流程在释放,
@@ -78,9 +137,11 @@ VideoPlayer::State VideoPlayer::getStatc() {
     return _state;
 }
 void VideoPlayer::setFilename(QString filename) {
-    char *name = filename.toUtf8().data();
-    // strlen只获取全部字符数量, 加1是因为还有\0结束符
-    memcpy(_filename, name, strlen(name) + 1);
+    // 单个文件当作只有一项的播放列表
+    setPlaylist(QStringList(filename));
+}
+QString VideoPlayer::getFilename() {
+    return QString::fromUtf8(_filename);
 }
 int64_t VideoPlayer::getDuration() {
     // 从ffmpeg的时间戳转化为显示时间秒
@@ -100,42 +161,259 @@ void VideoPlayer::setMute(bool mute) {
 bool VideoPlayer::isMute() {
     return _mute;
 }
+void VideoPlayer::setMmapEnabled(bool enabled) {
+    _mmapEnabled = enabled;
+}
+bool VideoPlayer::isMmapEnabled() {
+    return _mmapEnabled;
+}
+void VideoPlayer::setFastStart(bool fastStart) {
+    _fastStart = fastStart;
+}
+bool VideoPlayer::isFastStart() {
+    return _fastStart;
+}
+int64_t VideoPlayer::getFirstFrameTime() {
+    return _firstFrameTime;
+}
+void VideoPlayer::setVideoOutputSize(int width, int height) {
+    if (width == _vDisplayWidth && height == _vDisplayHeight) return;
+    _vDisplayWidth = std::max(width, 0);
+    _vDisplayHeight = std::max(height, 0);
+    // 视频解码线程转换下一帧前重建
+    _vSwsDirty = true;
+}
+void VideoPlayer::setDecodeThreadType(DecodeThreadType type) {
+    _decodeThreadType = type;
+}
+VideoPlayer::DecodeThreadType VideoPlayer::getDecodeThreadType() {
+    return _decodeThreadType;
+}
+void VideoPlayer::setDecodeThreadCount(int count) {
+    _decodeThreadCount = std::max(count, 0);
+}
+int VideoPlayer::getDecodeThreadCount() {
+    return _decodeThreadCount;
+}
+void VideoPlayer::setDecodeThreadCap(int cap) {
+    _decodeThreadCap = std::max(cap, 0);
+}
+int VideoPlayer::getDecodeThreadCap() {
+    return _decodeThreadCap;
+}
+int VideoPlayer::getActiveDecodeThreadCount() {
+    return _activeDecodeThreadCount;
+}
+VideoPlayer::DecodeThreadType VideoPlayer::getActiveDecodeThreadType() {
+    return (DecodeThreadType)_activeDecodeThreadType.load();
+}
+VideoPlayer::DegradeLevel VideoPlayer::getDegradeLevel() {
+    return (DegradeLevel)_vDegrade->level();
+}
+int VideoPlayer::getDroppedFrames() {
+    return _vDropFrames;
+}
+bool VideoPlayer::takeVideoFrame(FrameQueue::Frame &frame) {
+    return _vMailbox->take(frame);
+}
+VideoPlayer::PlaybackStats VideoPlayer::getPlaybackStats() {
+    PlaybackStats stats;
+    for (int i = 0; i < StageCount; i++) {
+        stats.stages[i] = _stageTimes[i].summary();
+    }
+    stats.audioPktQueueSize = _aPktQueue->size();
+    stats.videoPktQueueSize = _vPktQueue->size();
+    stats.videoFrameQueueSize = _vFrameQueue->size();
+    stats.droppedFrames = _vDropFrames;
+    stats.supersededFrames = _vMailbox->superseded();
+    stats.avDrift = _avDrift;
+    stats.maxAvDrift = _maxAvDrift;
+    stats.audioUnderruns = _aUnderruns;
+    stats.audioLatency = _aDeviceLatency;
+    stats.degradeLevel = _vDegrade->level();
+    return stats;
+}
+void VideoPlayer::resetPlaybackStats() {
+    for (int i = 0; i < StageCount; i++) {
+        _stageTimes[i].reset();
+    }
+    _avDrift = 0;
+    _maxAvDrift = 0;
+    _aUnderruns = 0;
+    _vMailbox->resetSuperseded();
+}
+void VideoPlayer::recordStageTime(Stage stage, int64_t time) {
+    if (stage < 0 || stage >= StageCount) return;
+    _stageTimes[stage].record(time);
+}
+const char *VideoPlayer::stageName(Stage stage) {
+    switch (stage) {
+    case StageDemux: return "demux";
+    case StageQueueWait: return "queue";
+    case StageDecode: return "decode";
+    case StageScale: return "sws";
+    case StageHandoff: return "handoff";
+    case StagePaint: return "paint";
+    case StageAudioFill: return "audio";
+    default: return "";
+    }
+}
+void VideoPlayer::setTracePath(const QString &path) {
+    _tracePath = path;
+}
+bool VideoPlayer::flushTrace(const QString &path) {
+    return Tracer::flush(path);
+}
+void VideoPlayer::setHeadless(MediaSink *sink) {
+    if (_state != Stopped) return;
+    _sink = sink;
+}
+bool VideoPlayer::isHeadless() {
+    return _sink != nullptr;
+}
+VideoPlayer::ThroughputStats VideoPlayer::getThroughputStats() {
+    ThroughputStats stats;
+    int64_t end = _throughputEnd;
+    stats.elapsed = (end > 0 ? end : av_gettime_relative()) - _openTime;
+    stats.demuxPackets = _throughput.demuxPackets;
+    stats.demuxTime = _throughput.demuxTime;
+    stats.videoDecodeFrames = _throughput.videoDecodeFrames;
+    stats.videoDecodeTime = _throughput.videoDecodeTime;
+    stats.videoScaleFrames = _throughput.videoScaleFrames;
+    stats.videoScaleTime = _throughput.videoScaleTime;
+    stats.videoOutputFrames = _throughput.videoOutputFrames;
+    stats.videoOutputTime = _throughput.videoOutputTime;
+    stats.audioDecodeSamples = _throughput.audioDecodeSamples;
+    stats.audioDecodeTime = _throughput.audioDecodeTime;
+    stats.audioOutputSamples = _throughput.audioOutputSamples;
+    stats.audioOutputTime = _throughput.audioOutputTime;
+    return stats;
+}
 int64_t VideoPlayer::getTime() {
-    return round(_aTime);
+    return round(useExternalClock() ? _extClock->time() : audioTime());
+}
+void VideoPlayer::setSpeed(double speed) {
+    speed = std::max(PLAYBACK_SPEED_MIN, std::min(speed, PLAYBACK_SPEED_MAX));
+    if (speed == _speed) return;
+    _speed = speed;
+    // 两个时钟从当前时间开始按新的速度走
+    _extClock->setRate(speed);
+    syncAudioClock();
+    _aClock->setRate(speed);
+    // 唤醒按旧速度定时等待的显示线程
+    _stateMutex->lock();
+    _stateMutex->broadcast();
+    _stateMutex->unlock();
+    TRACE_INSTANT("speed", speed);
+}
+double VideoPlayer::getSpeed() {
+    return _speed;
+}
+void VideoPlayer::setLowLatency(bool lowLatency) {
+    _lowLatency = lowLatency;
+}
+bool VideoPlayer::isLowLatency() {
+    return _lowLatency;
+}
+void VideoPlayer::setExternalClock(bool external) {
+    _externalClock = external;
+}
+bool VideoPlayer::isExternalClock() {
+    return _externalClock;
 }
 int64_t VideoPlayer::setTime(int time) {
     _seekTime = time;
-    qDebug() << "setTime" << time;
+    // 队列满时读文件线程在挂起, 唤醒它去处理seek
+    _aPktQueue->wakeup();
+    _vPktQueue->wakeup();
+    TRACE_INSTANT("setTime", time);
+}
+void VideoPlayer::scrub(int time) {
+    if (_state == Stopped) return;
+    _scrubbing = true;
+    // 还没处理的seek直接被新的位置覆盖
+    setTime(time);
+}
+void VideoPlayer::endScrub(int time) {
+    if (!_scrubbing) return;
+    _scrubbing = false;
+    setTime(time);
+}
+bool VideoPlayer::isScrubbing() {
+    return _scrubbing;
 }
 #pragma mark - 私有方法
+bool VideoPlayer::useExternalClock() {
+    return !_hasAudio || _externalClock;
+}
+double VideoPlayer::audioTime() {
+    syncAudioClock();
+    return _aClock->isSet() ? _aClock->time() : _aTime;
+}
+void VideoPlayer::publishAudioAnchor(double time) {
+    // 只有SDL回调写, 序号是奇数时读的线程重新读
+    uint32_t seq = _aAnchorSeq.load(std::memory_order_relaxed);
+    _aAnchorSeq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    _aAnchorTime.store(time, std::memory_order_relaxed);
+    _aAnchorStamp.store(MasterClock::now(), std::memory_order_relaxed);
+    _aAnchorSeq.store(seq + 2, std::memory_order_release);
+}
+void VideoPlayer::syncAudioClock() {
+    uint32_t seq;
+    double time;
+    int64_t stamp;
+    do {
+        seq = _aAnchorSeq.load(std::memory_order_acquire);
+        if (seq == _aAnchorApplied) return;
+        time = _aAnchorTime.load(std::memory_order_relaxed);
+        stamp = _aAnchorStamp.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((seq & 1) || seq != _aAnchorSeq.load(std::memory_order_relaxed));
+    _aAnchorApplied = seq;
+    // 几个线程同时设置时, 旧锚点会被_aClock忽略
+    _aClock->setAnchor(time, stamp);
+}
+void VideoPlayer::resetAudioClock() {
+    _aAnchorApplied = _aAnchorSeq.load();
+    _aClock->reset();
+}
 void VideoPlayer::setState(State state) {
     if (_state == state) return;
+    _stateMutex->lock();
     _state = state;
+    // 外部时钟、音频时钟跟着暂停恢复(暂停时声卡不再取数据)
+    _extClock->setPaused(state != Playing);
+    syncAudioClock();
+    _aClock->setPaused(state != Playing);
+    // 唤醒暂停挂起的视频解码线程, 以及音视频同步中定时等待的线程
+    _stateMutex->broadcast();
+    _stateMutex->unlock();
+
+    // 不是播放状态就暂停SDL音频设备, 暂停期间不再空跑回调
+    // 恢复播放由调用者决定时机(快速启动要先显示第一帧画面再出声音)
+    if (_hasAudio && !_sink && state != Playing) {
+        SDL_PauseAudioDevice(_aDevice, 1);
+    }
 
     // 播放状态改变发送信号
     emit videoStatcChanged(this);
 }
-void VideoPlayer::readFile() {
+void VideoPlayer::readFile(int session) {
+    TRACE_THREAD("demux");
 
     // 返回结果
     int ret = 0;
     // 创建解封装上下文
-    ret  = avformat_open_input(&_fmtCxt, _filename, nullptr, nullptr);
+    ret = openInput(_filename, &_fmtCxt, &_mmapIO);
     END(avformat_open_input);
 
     // 检索音频,视频流信息, 比如音频 采样率 声道 采样格式 比特率, 视频 宽高 存储格式等等
-    ret = avformat_find_stream_info(_fmtCxt, nullptr);
+    ret = findStreamInfo(_filename, _fmtCxt);
     END(avformat_find_stream_info);
 
-    // 打印流信息到控制台(这是用于调试的)
-    // 流信息都dump到stderr
-    av_dump_format(_fmtCxt, 0, _filename, 0);
-    // 刷新打印缓冲区
-    fflush(stderr);
-
     // 初始化音视频信息
-    _hasAudio = initAudioInfo() >= 0;
-    _hasVideo = initVideoInfo() >= 0;
+    initMediaInfo();
     // 都不是音频和视频文件返回
     if (!_hasAudio && !_hasVideo) {
         fataError();
@@ -148,66 +426,111 @@ void VideoPlayer::readFile() {
     // 音视频初始化完毕
     emit videoInitFinished(this);
 
+    // 开启新线程, 按时间戳把解码好的画面交给外界显示
+    if (_hasVideo) {
+        std::thread([this](){
+            presentVideo();
+        }).detach();
+    }
+
+    // 快速启动: 音频开始前先解码显示第一帧画面
+    if (_fastStart && _hasVideo) {
+        presentPoster();
+    }
+
+    // 开启音频解码线程, 解码好的声音写入环形缓冲, 无界面模式没有声卡, 全速解码
+    if (_hasAudio) {
+        std::thread([this](){
+            pumpAudio();
+        }).detach();
+    }
     // 音频子线程开始播放 0是取消暂停, 1是暂停播放.
-    SDL_PauseAudio(0);
+    if (_hasAudio && !_sink) {
+        SDL_PauseAudioDevice(_aDevice, 0);
+    }
 
     // 开启新线程, 视频像素格式开始解码
     std::thread([this](){
         decodervideo();
     }).detach();
 
+    // 播放列表后台预加载下一个文件
+    startPreload();
+
     // 从输入文件流数据中读取数据
     AVPacket pkt;
+    // 是否正常播放完毕
+    bool finished = false;
     while (_state != Stopped) {
+        // 释放解码线程都已经切换过来的上一个文件
+        if (!_retiredItems.empty()) {
+            freeRetiredItems(false);
+        }
 
         if (_seekTime >= 0) {
-            int streamId;
-            if (_hasAudio) { // 优先考虑音频流
-                streamId = _aStream->index;
-            }else {
-                streamId = _vStream->index;
-            }
-            // 现实时间转为时间戳
-            int64_t seekTimestamp = _seekTime  / av_q2d(_fmtCxt->streams[streamId]->time_base);
-            // seek操作
-            // 可以认为seek其中一条流,
-            ret = av_seek_frame(_fmtCxt,
-                                streamId,
-                                seekTimestamp,
-                                AVSEEK_FLAG_BACKWARD);
+            ret = seekFile();
             if (ret < 0) {
-                qDebug() << "seek失败" << seekTimestamp;
+                qDebug() << "seek失败" << _seekTime;
                 _seekTime = -1;
                 CONTINUE(av_seek_frame);
             }else {
-                qDebug() << "seek成功" << seekTimestamp << _seekTime;
-                _vSeekTime = _seekTime;
+                TRACE_INSTANT("seek", _seekTime);
+                // 拖动中seek位置前面的关键帧就直接显示, 不再解码到seek时刻
+                _vSeekTime = _scrubbing ? 0 : _seekTime;
                 _aSeekTime = _seekTime;
                 _seekTime = -1;
-                // 清除之前的pkt列表
+                // 清除之前的pkt队列
                 // 这里要先处理之前pkt资源列表再恢复时钟, 不然往回seek时候会出现视频解码线程抢到一部分旧pkt包,
                 // 而之后时钟已经重置过了, vTime用回旧pkt包时钟, _aTime用新pkt包时钟, 造成为了同步音视频, 视频不断在等待音频.
+                _aSeekSerial++;
                 clearAudioList();
                 clearVideoList();
                 // 恢复pkt时钟, 防止视频解码pkt时, 还用seek前的时钟判断是否音视频同步, 出现不断等待循环
                 _aTime = 0;
+                resetAudioClock();
                 _vTime = 0;
+                // 外部时钟等seek后的第一帧重新设置
+                _extClock->reset();
+                // 唤醒暂停中的视频解码线程去解码seek位置的画面
+                _stateMutex->lock();
+                // 读到文件尾部后又seek, 重新读到尾部时再取出解码器缓存的帧
+                _eofDrainQueued = false;
+                _vDrained = false;
+                // 还没切换完的播放列表文件, 切换包也被清掉了, 重新放入
+                for (size_t i = 0; i < _aSwitchItems.size(); i++) {
+                    addSwitchPkt(_aPktQueue);
+                }
+                for (size_t i = 0; i < _vSwitchItems.size(); i++) {
+                    addSwitchPkt(_vPktQueue);
+                }
+                _stateMutex->broadcast();
+                _stateMutex->unlock();
             }
         }
 
 
-        // 因为av_read_frame读取资源很快放入资源列表, 防止list资源列表太多暂用内存太多
-        if (_aPktList->size() >= AUDIO_MAX_PKT_SIZE
-                || _vPktList->size() >= VIDEO_MAX_PKT_SIZE) {
-//            SDL_Delay(10);
+        // 因为av_read_frame读取资源很快放入包队列, 队列满了就挂起等待解码线程取走包, 不空转
+        if (_aPktQueue->isFull()) {
+            _aPktQueue->waitForSpace();
+            continue;
+        }
+        if (_vPktQueue->isFull()) {
+            _vPktQueue->waitForSpace();
             continue;
         }
 
+        int64_t readStart = av_gettime_relative();
+        TRACE_BEGIN("read", -1);
         ret = av_read_frame(_fmtCxt, &pkt);
+        TRACE_END("read", -1);
         if (ret == 0) {
-            if (pkt.stream_index == _aStream->index) {// 音频数据
+            int64_t readTime = av_gettime_relative() - readStart;
+            _throughput.demuxTime += readTime;
+            _throughput.demuxPackets++;
+            _stageTimes[StageDemux].record(readTime);
+            if (pkt.stream_index == _aStreamIdx) {// 音频数据
                 addAudioPkt(pkt);
-            }else if (pkt.stream_index == _vStream->index) {// 视频数据
+            }else if (pkt.stream_index == _vStreamIdx) {// 视频数据
                 addVideoPkt(pkt);
             }else {// 非音频 视频不处理, 释放pkt
                 av_packet_unref(&pkt);
@@ -219,12 +542,37 @@ void VideoPlayer::readFile() {
             // 有seek功能这里不能break出循环了
 //            break;
 
-            // 播放完成停止
-            if (_vPktList->size() == 0 && _aPktList->size() == 0) {
+            // 播放列表有预加载好的下一个文件, 无缝切换过去接着读
+            if (switchItem()) {
+                continue;
+            }
+
+            // 送空包把解码器里缓存的帧都取出来, 最后几帧也要显示\输出
+            if (_hasVideo && !_eofDrainQueued) {
+                _eofDrainQueued = true;
+                addVideoDrainPkt();
+                continue;
+            }
+
+            // 播放完成停止, 要等解码器缓存的帧都取出来、画面队列里的帧都显示\输出完, 正常播放还要等环形缓冲里的声音播完
+            bool drained = (!_hasVideo || (_vDrained && _vFrameQueue->size() == 0))
+                    && (_sink || !_hasAudio || _aRing->available() == 0);
+            if (_vPktQueue->isEmpty() && _aPktQueue->isEmpty() && drained) {
                 // 说明正常播放完毕
-                _fmtCxtCanFree = true;
+                finished = true;
                 break;
             }
+            // 挂起等待解码线程把剩下的包取完, 不空转读文件尾部
+            if (!_vPktQueue->isEmpty()) {
+                _vPktQueue->waitForEmpty();
+            }else if (!_aPktQueue->isEmpty()) {
+                _aPktQueue->waitForEmpty();
+            }else {
+                // 显示线程取走最后几帧时不会唤醒, 定时再看
+                _stateMutex->lock();
+                _stateMutex->waitTimeout(10);
+                _stateMutex->unlock();
+            }
         } else {
             // 如果播放期间某个包出现错误, 继续处理先.这不影响整体播放就好
             ERROR_BUF(ret);
@@ -232,48 +580,246 @@ void VideoPlayer::readFile() {
             continue;
         }
     }
-    // 标记fmtCxt可以释放
-    if (_fmtCxtCanFree) {
-        stop();
+    // 标记fmtCxt可以释放, 之后读文件线程不再访问任何状态, 用户停止时free()可以马上释放并重置
+    setCanFree(_fmtCxtCanFree);
+    if (finished) {
+        // 正常播放完毕, 停止和打开下一个文件交给界面线程, 不和用户的停止\播放同时进行
+        QMetaObject::invokeMethod(this, [this, session]() {
+            playNextItem(session);
+        }, Qt::QueuedConnection);
+    }
+
+}
+
+int VideoPlayer::openInput(const char *filename, AVFormatContext **fmtCxt, MmapIO **mmapIO) {
+    // 本地文件用内存映射读取, 映射失败就回退到ffmpeg默认的文件读取
+    if (_mmapEnabled) {
+        *mmapIO = new MmapIO();
+        *fmtCxt = avformat_alloc_context();
+        if (*fmtCxt && (*mmapIO)->open(filename) >= 0) {
+            // 设置了pb, avformat_open_input会使用自定义IO
+            (*fmtCxt)->pb = (*mmapIO)->avioCxt();
+        }else {
+            delete *mmapIO;
+            *mmapIO = nullptr;
+        }
+    }
+    return avformat_open_input(fmtCxt, filename, nullptr, nullptr);
+}
+
+int VideoPlayer::findStreamInfo(const char *filename, AVFormatContext *fmtCxt) {
+    // 快速启动优先用缓存的探测结果, 跳过avformat_find_stream_info
+    if (_fastStart && ProbeCache::read(filename, fmtCxt)) {
+        qDebug() << "probe cache hit";
+        return 0;
+    }
+
+    int ret = avformat_find_stream_info(fmtCxt, nullptr);
+    if (ret < 0) return ret;
+
+    if (_fastStart) {
+        ProbeCache::write(filename, fmtCxt);
     }else {
-        _fmtCxtCanFree = true;
+        // 打印流信息到控制台(这是用于调试的)
+        // 流信息都dump到stderr
+        av_dump_format(fmtCxt, 0, filename, 0);
+        // 刷新打印缓冲区
+        fflush(stderr);
     }
+    return 0;
+}
 
+void VideoPlayer::initMediaInfo() {
+    if (!_fastStart) {
+        _hasAudio = initAudioInfo() >= 0;
+        _hasVideo = initVideoInfo() >= 0;
+    }else {
+        // 快速启动: 音频(解码器+重采样+SDL)和视频(解码器+像素格式转换)互不依赖, 并行初始化
+        std::thread audioThread([this]() {
+            _hasAudio = initAudioInfo() >= 0;
+        });
+        _hasVideo = initVideoInfo() >= 0;
+        audioThread.join();
+    }
+    // 读文件线程按流索引分发包
+    _aStreamIdx = _hasAudio ? _aStream->index : -1;
+    _vStreamIdx = _hasVideo ? _vStream->index : -1;
+}
+
+int VideoPlayer::seekFile() {
+    // 播放列表切换文件时解码线程可能还在用上一个文件的流, 这里用读文件线程自己的流索引
+    // 有关键帧索引, 直接跳到seek时刻前面最近的关键帧
+    SeekIndex::Entry keyFrame;
+    AVStream *vStream = _vStreamIdx >= 0 ? _fmtCxt->streams[_vStreamIdx] : nullptr;
+    bool found = vStream && _vSeekIndex->find(_seekTime / av_q2d(vStream->time_base), keyFrame);
+    _vSeekFrames = -1;
+
+    // 内存映射读取时, 提前让系统预读seek目标在文件中的位置(在读文件线程里做, _mmapIO和文件一起在读文件线程结束后才释放)
+    // 有关键帧索引就用关键帧的位置, 没有就按时长比例估算
+    if (_mmapIO) {
+        if (found && keyFrame.pos >= 0) {
+            _mmapIO->prefetch(keyFrame.pos);
+        }else if (_fmtCxt->duration > 0) {
+            _mmapIO->prefetch(_mmapIO->size() * _seekTime / (_fmtCxt->duration * av_q2d(AV_TIME_BASE_Q)));
+        }
+    }
+
+    if (found) {
+        int ret;
+        // 没有容器索引的格式(ts\ps有时间戳跳变, 裸流)按时间戳seek要靠二分读文件去找, 直接跳到关键帧所在的字节位置;
+        // mp4\mkv等有索引的格式按字节seek会落在样本表之外, 还是按时间戳seek
+        const AVInputFormat *iformat = _fmtCxt->iformat;
+        bool noIndex = (iformat->flags & AVFMT_TS_DISCONT)
+                || av_match_name(iformat->name, "h264,hevc,mpegvideo,m4v");
+        if (noIndex && keyFrame.pos >= 0 && !(iformat->flags & AVFMT_NO_BYTE_SEEK)) {
+            ret = av_seek_frame(_fmtCxt, -1, keyFrame.pos, AVSEEK_FLAG_BYTE);
+        }else {
+            ret = av_seek_frame(_fmtCxt, _vStreamIdx, keyFrame.pts, AVSEEK_FLAG_BACKWARD);
+        }
+        if (ret >= 0) {
+            // 从关键帧解码到seek时刻最多是这个GOP的帧数, 关键帧本身不丢
+            _vSeekFrames = _scrubbing ? -1 : std::max(keyFrame.frames - 1, 0);
+            return ret;
+        }
+    }
+
+    int streamId;
+    if (_aStreamIdx >= 0) { // 优先考虑音频流
+        streamId = _aStreamIdx;
+    }else {
+        streamId = _vStreamIdx;
+    }
+    // 现实时间转为时间戳
+    int64_t seekTimestamp = _seekTime  / av_q2d(_fmtCxt->streams[streamId]->time_base);
+    // seek操作
+    // 可以认为seek其中一条流,
+    return av_seek_frame(_fmtCxt,
+                         streamId,
+                         seekTimestamp,
+                         AVSEEK_FLAG_BACKWARD);
 }
 
 void VideoPlayer::free() {
-    while(_hasAudio && !_aCanFree);
-    while(_hasVideo && !_vCanFree);
-    while(!_fmtCxtCanFree);
+    // 挂起等待视频解码、显示线程、音频解码线程和读文件线程走完, 音频回调由SDL_CloseAudioDevice等待结束(见freeAudio)
+    _stateMutex->lock();
+    while (_hasVideo && (!_vCanFree || !_vPresentCanFree)) {
+        _stateMutex->wait();
+    }
+    while (_hasAudio && !_aCanFree) {
+        _stateMutex->wait();
+    }
+    while (!_fmtCxtCanFree) {
+        _stateMutex->wait();
+    }
+    _stateMutex->unlock();
     avformat_close_input(&_fmtCxt);
+    // 自定义IO不会被avformat_close_input释放
+    delete _mmapIO;
+    _mmapIO = nullptr;
     _fmtCxtCanFree = false;
     _seekTime = -1;
+    _scrubbing = false;
+    _extClock->reset();
 
     freeAudio();
     freeVideo();
+
+    // 解码线程都已经结束, 释放播放列表预加载和切换中的文件
+    if (_preloadThread.joinable()) {
+        _preloadThread.join();
+    }
+    freeMediaItem(_nextItem);
+    _nextItem = nullptr;
+    _aSwitchItems.clear();
+    _vSwitchItems.clear();
+    freeRetiredItems(true);
+    _aSerial = 0;
+    _vSerial = 0;
+    _aStreamIdx = -1;
+    _vStreamIdx = -1;
+    _eofDrainQueued = false;
+
+    // 线程都已经走完, 写出这次播放的追踪事件
+    if (!_tracePath.isEmpty()) {
+        Tracer::flush(_tracePath);
+    }
+
+    // 无界面模式结束, 线程都已经走完, 统计是完整的
+    if (_sink) {
+        _throughputEnd = av_gettime_relative();
+        logThroughput();
+        emit headlessFinished(this);
+    }
+}
+
+void VideoPlayer::setCanFree(bool &canFree) {
+    _stateMutex->lock();
+    canFree = true;
+    _stateMutex->broadcast();
+    _stateMutex->unlock();
+}
+
+void VideoPlayer::resetThroughput() {
+    _throughput.demuxPackets = 0;
+    _throughput.demuxTime = 0;
+    _throughput.videoDecodeFrames = 0;
+    _throughput.videoDecodeTime = 0;
+    _throughput.videoScaleFrames = 0;
+    _throughput.videoScaleTime = 0;
+    _throughput.videoOutputFrames = 0;
+    _throughput.videoOutputTime = 0;
+    _throughput.audioDecodeSamples = 0;
+    _throughput.audioDecodeTime = 0;
+    _throughput.audioOutputSamples = 0;
+    _throughput.audioOutputTime = 0;
+    _throughputEnd = 0;
+}
+
+// 每秒处理多少个, time单位是微妙
+static double perSecond(int64_t count, int64_t time) {
+    return time > 0 ? count * 1000000.0 / time : 0;
+}
+
+void VideoPlayer::logThroughput() {
+    ThroughputStats stats = getThroughputStats();
+    // 各阶段单独的速度(个数/这一阶段的耗时), 以及整体的速度(个数/总时间)
+    qDebug() << "throughput elapsed(ms):" << stats.elapsed / 1000
+             << "demux pkts/s:" << perSecond(stats.demuxPackets, stats.demuxTime);
+    qDebug() << "throughput video frames:" << stats.videoOutputFrames
+             << "decode fps:" << perSecond(stats.videoDecodeFrames, stats.videoDecodeTime)
+             << "scale fps:" << perSecond(stats.videoScaleFrames, stats.videoScaleTime)
+             << "output fps:" << perSecond(stats.videoOutputFrames, stats.videoOutputTime)
+             << "overall fps:" << perSecond(stats.videoOutputFrames, stats.elapsed);
+    qDebug() << "throughput audio samples:" << stats.audioOutputSamples
+             << "decode samples/s:" << perSecond(stats.audioDecodeSamples, stats.audioDecodeTime)
+             << "output samples/s:" << perSecond(stats.audioOutputSamples, stats.audioOutputTime)
+             << "overall samples/s:" << perSecond(stats.audioOutputSamples, stats.elapsed);
 }
 
 void VideoPlayer::fataError() {
+    // 只会在读文件线程初始化时调用, 读文件线程自己就是fmtCxt的使用者, 直接标记可以释放
+    _fmtCxtCanFree = true;
     setState(Stopped);
     emit VideoPlayer::videoPlayFalied(this);
     free();
 }
 
 // 初始化解码器
-int VideoPlayer::initDecoder(AVCodecContext **decodeCxt ,
+int VideoPlayer::initDecoder(AVFormatContext *fmtCxt,
+                             AVCodecContext **decodeCxt ,
                              AVMediaType type,
                              AVStream **stream) {
 
     int ret = 0;
     // 寻找合适的流信息, 返回对应的流索引
-    ret = av_find_best_stream(_fmtCxt, type,
+    ret = av_find_best_stream(fmtCxt, type,
                             // 后面参数先参考官方怎么传
                             -1, -1, nullptr, 0);
     RET(av_find_best_stream);
 
     int streamIdx = ret;
     // 根据返回的流索引, 查看是否存在对应的流
-    *stream = _fmtCxt->streams[streamIdx];
+    *stream = fmtCxt->streams[streamIdx];
     if (!*stream) {
         qDebug() << "stream is empty";
         return -1;
@@ -298,10 +844,34 @@ int VideoPlayer::initDecoder(AVCodecContext **decodeCxt ,
     ret = avcodec_parameters_to_context(*decodeCxt, (*stream)->codecpar);
     RET(avcodec_parameters_to_context);
 
+    // 视频按配置多线程解码
+    if (type == AVMEDIA_TYPE_VIDEO) {
+        initDecodeThreads(*decodeCxt, decoder);
+    }
+
     // 打开解码器
     ret = avcodec_open2(*decodeCxt, decoder, nullptr);
     RET(avcodec_open2);
 
+    // 打印实际协商的线程数和线程模型, active_thread_type为0说明单线程解码
+    if (type == AVMEDIA_TYPE_VIDEO) {
+        int active = (*decodeCxt)->active_thread_type;
+        qDebug() << "video decoder" << decoder->name
+                 << "threads:" << (*decodeCxt)->thread_count
+                 << "type:" << ((active & FF_THREAD_FRAME) ? "frame" : (active & FF_THREAD_SLICE) ? "slice" : "none");
+    }
+
     return 0;
 }
 
+void VideoPlayer::updateActiveDecodeThreads(AVCodecContext *decodeCxt) {
+    DecodeThreadType type = ThreadAuto;
+    if (decodeCxt && (decodeCxt->active_thread_type & FF_THREAD_FRAME)) {
+        type = ThreadFrame;
+    }else if (decodeCxt && (decodeCxt->active_thread_type & FF_THREAD_SLICE)) {
+        type = ThreadSlice;
+    }
+    _activeDecodeThreadCount = decodeCxt ? decodeCxt->thread_count : 0;
+    _activeDecodeThreadType = type;
+}
+
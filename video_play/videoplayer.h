@@ -2,13 +2,34 @@
 #define VIDEOPLAYER_H
 
 #include <QObject>
+#include <QStringList>
 #include <list>
+#include <vector>
+#include <atomic>
+#include <thread>
 #include "condmutex.h"
+#include "pktqueue.h"
+#include "framequeue.h"
+#include "framemailbox.h"
+#include "pcmring.h"
+#include "sampleconverter.h"
+#include "timestretch.h"
+#include "mmapio.h"
+#include "seekindex.h"
+#include "probecache.h"
+#include "slicescaler.h"
+#include "degradecontroller.h"
+#include "masterclock.h"
+#include "mediasink.h"
+#include "latencyhistogram.h"
+#include "tracer.h"
 extern "C" {
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
 #include <libavutil/imgutils.h>
 #include <libavutil/avutil.h>
+#include <libavutil/avstring.h>
+#include <libavutil/time.h>
 #include <libswresample/swresample.h>
 #include <libswscale/swscale.h>
 #include <SDL2/SDL.h>
@@ -47,6 +68,29 @@ public:
         Max = 100,
     }Volume;
 
+    // 视频解码线程模型
+    typedef enum {
+        // 解码器支持帧多线程就用帧多线程, 否则用片多线程
+        ThreadAuto = 0,
+        // 帧多线程: 多帧并行解码, 吞吐量高, 但是多出thread_count帧的延迟
+        ThreadFrame,
+        // 片多线程: 一帧内的多个slice并行解码, 没有额外延迟, 依赖码流分片
+        ThreadSlice
+    } DecodeThreadType;
+
+    // 视频跟不上时的降级级别, 级别越高越省, 每一级包含前面所有级的措施
+    typedef enum {
+        DegradeNone = 0,
+        // 缩放换成更快的算法
+        DegradeFastScale,
+        // 跳过环路滤波
+        DegradeSkipLoopFilter,
+        // 不解码非参考帧
+        DegradeSkipNonRef,
+        // 只解码关键帧
+        DegradeKeyFrameOnly
+    } DegradeLevel;
+
     // 视频像素格式转换参数
     typedef struct {
         int width;
@@ -55,6 +99,63 @@ public:
         int size;
     } VideoSwsSpec;
 
+    // 统计耗时的阶段
+    typedef enum {
+        // 解封装读一个包
+        StageDemux = 0,
+        // 画面在画面队列里等待显示
+        StageQueueWait,
+        // 视频解码一帧
+        StageDecode,
+        // 像素格式转换一帧
+        StageScale,
+        // 画面从显示线程交到界面线程(无界面模式是交给输出)
+        StageHandoff,
+        // 界面绘制一帧
+        StagePaint,
+        // SDL音频回调填充一次缓冲区
+        StageAudioFill,
+        StageCount
+    } Stage;
+
+    // 播放统计
+    typedef struct {
+        /** 各阶段耗时*/
+        LatencyHistogram::Summary stages[StageCount];
+        /** 音频\视频包队列里的包数, 画面队列里的画面数*/
+        int audioPktQueueSize, videoPktQueueSize, videoFrameQueueSize;
+        /** 来不及显示丢弃的画面数*/
+        int droppedFrames;
+        /** 界面线程没来得及画就被新画面覆盖的画面数*/
+        int supersededFrames;
+        /** 最近显示的画面时间减主时钟(正数是画面早了), 以及绝对值最大的一次 单位是微妙*/
+        int64_t avDrift, maxAvDrift;
+        /** 音频回调没有数据, 填充静音的次数*/
+        int audioUnderruns;
+        /** 音频时钟补偿的声卡延迟 单位是微妙*/
+        int64_t audioLatency;
+        /** 视频降级级别*/
+        int degradeLevel;
+    } PlaybackStats;
+
+    // 各阶段吞吐量统计, 时间单位是微妙, 个数除以耗时就是这一阶段单独能跑多快
+    typedef struct {
+        /** 从play到播放结束(还没结束就是到现在)的时间*/
+        int64_t elapsed;
+        /** 解封装读出的包数和耗时*/
+        int64_t demuxPackets, demuxTime;
+        /** 视频解码出的帧数和耗时*/
+        int64_t videoDecodeFrames, videoDecodeTime;
+        /** 像素格式转换的帧数和耗时*/
+        int64_t videoScaleFrames, videoScaleTime;
+        /** 交给输出的帧数和耗时*/
+        int64_t videoOutputFrames, videoOutputTime;
+        /** 音频解码(含重采样)输出的样本数和耗时*/
+        int64_t audioDecodeSamples, audioDecodeTime;
+        /** 交给输出的样本数和耗时*/
+        int64_t audioOutputSamples, audioOutputTime;
+    } ThroughputStats;
+
     explicit VideoPlayer(QObject *parent = nullptr);
     ~VideoPlayer();
     /** 播放*/
@@ -69,12 +170,20 @@ public:
     State getStatc();
     /** 设置文件路径*/
     void setFilename(QString filename);
+    /** 当前播放的文件路径*/
+    QString getFilename();
     /** 获取视频总时长 单位是微妙*/
     int64_t getDuration();
     /** 获取当前播放时间*/
     int64_t getTime();
     /** 设置(seek)播放时间*/
     int64_t setTime(int time);
+    /** 拖动进度条中seek, 只解码显示关键帧, 连续调用只处理最新的位置*/
+    void scrub(int time);
+    /** 结束拖动, 精确seek到time*/
+    void endScrub(int time);
+    /** 是否在拖动进度条*/
+    bool isScrubbing();
     /** 设置音量*/
     void setVolume(int volume);
     /** 返回音量*/
@@ -83,6 +192,87 @@ public:
     void setMute(bool mute);
     /** 返回音量*/
     bool isMute();
+    /** 设置本地文件是否用内存映射读取(下次打开文件生效)*/
+    void setMmapEnabled(bool enabled);
+    /** 是否用内存映射读取*/
+    bool isMmapEnabled();
+    /** 设置快速启动(使用缓存的探测结果、并行打开解码器、音频开始前先显示第一帧)*/
+    void setFastStart(bool fastStart);
+    /** 是否快速启动*/
+    bool isFastStart();
+    /** 从play到显示第一帧画面用了多久 单位是微妙, 还没显示返回-1*/
+    int64_t getFirstFrameTime();
+    /** 设置视频显示区域大小(物理像素), 像素格式转换直接缩放到这个大小, 0是原始大小*/
+    void setVideoOutputSize(int width, int height);
+    /** 设置视频解码线程模型(下次打开文件生效)*/
+    void setDecodeThreadType(DecodeThreadType type);
+    /** 视频解码线程模型*/
+    DecodeThreadType getDecodeThreadType();
+    /** 设置视频解码线程数, 0是按CPU核数自动(下次打开文件生效)*/
+    void setDecodeThreadCount(int count);
+    /** 视频解码线程数*/
+    int getDecodeThreadCount();
+    /** 设置每个播放器最多用几个解码线程, 同时播放多路时限制占用, 0不限制*/
+    void setDecodeThreadCap(int cap);
+    /** 解码线程数上限*/
+    int getDecodeThreadCap();
+    /** 解码器实际使用的线程数, 还没打开解码器返回0*/
+    int getActiveDecodeThreadCount();
+    /** 解码器实际使用的线程模型*/
+    DecodeThreadType getActiveDecodeThreadType();
+    /** 设置播放列表(停止状态下调用), 从第一个开始播放, 播放时会在后台预加载下一个无缝切换*/
+    void setPlaylist(const QStringList &filenames);
+    /** 当前播放的是播放列表第几个*/
+    int getPlaylistIndex();
+    /** 设置播放列表是否循环播放*/
+    void setPlaylistLoop(bool loop);
+    /** 播放列表是否循环播放*/
+    bool isPlaylistLoop();
+    /**
+     * 设置低延迟模式(下次play生效), 用于对口型要求高的场合
+     * 音频设备缓冲区更小, 画面晚于音频时钟超过一个很小的阈值就丢弃, 不等下一帧也到时刻
+     */
+    void setLowLatency(bool lowLatency);
+    /** 是否低延迟模式*/
+    bool isLowLatency();
+    /**
+     * 设置播放速度(0.25~4倍, 超出范围取边界), 立即生效
+     * 声音变速不变调, 画面按时钟加快或放慢, 2倍速以上不解码非参考帧; 无界面模式不受影响
+     */
+    void setSpeed(double speed);
+    /** 播放速度*/
+    double getSpeed();
+    /** 设置有音频的文件也用外部时钟做主时钟(没有音频的文件总是用外部时钟)*/
+    void setExternalClock(bool external);
+    /** 是否设置了外部时钟*/
+    bool isExternalClock();
+    /**
+     * 设置无界面模式(停止状态下调用, 下次play生效), sink由调用者释放, nullptr恢复正常播放
+     * 不打开声卡, 画面不等待时钟也不降级, 解码出的画面和PCM全速交给sink, 读到文件尾部时把解码器里的帧都取出来再结束
+     */
+    void setHeadless(MediaSink *sink);
+    /** 是否无界面模式*/
+    bool isHeadless();
+    /** 各阶段吞吐量统计, 无界面模式结束时打印一次*/
+    ThroughputStats getThroughputStats();
+    /** 播放统计, 各阶段耗时直方图、队列深度、丢帧、音画偏差、音频欠载*/
+    PlaybackStats getPlaybackStats();
+    /** 清空播放统计(play时也会清空)*/
+    void resetPlaybackStats();
+    /** 记录一个阶段的耗时 单位是微妙, 交接和绘制由显示控件记录*/
+    void recordStageTime(Stage stage, int64_t time);
+    /** 阶段名称*/
+    static const char *stageName(Stage stage);
+    /** 停止时把追踪事件写到这个文件, 空的不写(需要定义VIDEO_TRACE编译)*/
+    void setTracePath(const QString &path);
+    /** 立即把追踪事件写到文件*/
+    bool flushTrace(const QString &path);
+    /** 当前视频降级级别*/
+    DegradeLevel getDegradeLevel();
+    /** 来不及显示丢弃的画面数(不含降级后解码器跳过的帧)*/
+    int getDroppedFrames();
+    /** 取出最新的画面(界面线程收到videoFrameAvailable后调用), buf的引用归调用者, 显示完av_buffer_unref归还缓冲池*/
+    bool takeVideoFrame(FrameQueue::Frame &frame);
 
 
 signals:
@@ -90,13 +280,18 @@ signals:
     void timeChanged(VideoPlayer *player);
     void videoInitFinished(VideoPlayer *player);
     void videoPlayFalied(VideoPlayer *player);
-    void videoPlayFrameDecoded(VideoPlayer *player, uint8_t *data,VideoSwsSpec &spec);
+    /** 有新画面可以取了(在显示线程发出), 接收者调用takeVideoFrame取最新的一帧, 取走之前不会重复发出*/
+    void videoFrameAvailable(VideoPlayer *player);
+    /** 无界面模式播放结束, 资源都已释放(在播放器的线程发出)*/
+    void headlessFinished(VideoPlayer *player);
 private:
     /**********公共方法************/
     /** 文件路径*/
     char _filename[512];
     /** 当前的状态*/
     State _state = Stopped;
+    /** 状态锁, 状态变化、seek、资源可以释放时广播, 唤醒挂起等待的线程*/
+    CondMutex *_stateMutex = nullptr;
     /** 解封装上下文*/
     AVFormatContext *_fmtCxt = nullptr;
     /** 解封装上下文是否可以释放*/
@@ -107,19 +302,100 @@ private:
     bool _mute = false;
     /** seek时间*/
     int64_t _seekTime = -1;
+    /** 是否在拖动进度条, 拖动中只解码关键帧并且静音*/
+    std::atomic<bool> _scrubbing{false};
+    /** 外部主时钟, 没有音频或者设置了外部时钟时画面按它显示*/
+    MasterClock *_extClock = nullptr;
+    /** 有音频时也用外部时钟*/
+    std::atomic<bool> _externalClock{false};
+    /** 外部时钟锚点对应的播放列表切换序号(只有显示线程访问)*/
+    int _extClockSerial = 0;
+    /** 本地文件是否用内存映射读取*/
+    bool _mmapEnabled = false;
+    /** 内存映射读取, 为空说明用ffmpeg默认的文件读取*/
+    MmapIO *_mmapIO = nullptr;
+    /** 是否快速启动*/
+    bool _fastStart = false;
+    /** 是否低延迟模式*/
+    bool _lowLatency = false;
+    /** 播放速度*/
+    std::atomic<double> _speed{1.0};
+    /** 调用play的时刻 单位是微妙*/
+    int64_t _openTime = 0;
+    /** 从play到显示第一帧画面用的时间 单位是微妙(显示线程写, 界面线程读)*/
+    std::atomic<int64_t> _firstFrameTime{-1};
+    /** 无界面模式的输出, 为空是正常播放*/
+    MediaSink *_sink = nullptr;
+    /** 读到文件尾部后是否已经放入了取出解码器缓存帧的空包(只有读文件线程访问)*/
+    bool _eofDrainQueued = false;
+    // 吞吐量计数, 每一项只有一个线程累加
+    struct {
+        std::atomic<int64_t> demuxPackets{0}, demuxTime{0};
+        std::atomic<int64_t> videoDecodeFrames{0}, videoDecodeTime{0};
+        std::atomic<int64_t> videoScaleFrames{0}, videoScaleTime{0};
+        std::atomic<int64_t> videoOutputFrames{0}, videoOutputTime{0};
+        std::atomic<int64_t> audioDecodeSamples{0}, audioDecodeTime{0};
+        std::atomic<int64_t> audioOutputSamples{0}, audioOutputTime{0};
+    } _throughput;
+    /** 播放结束的时刻 单位是微妙, 0是还没结束*/
+    std::atomic<int64_t> _throughputEnd{0};
+    /** 各阶段耗时直方图*/
+    LatencyHistogram _stageTimes[StageCount];
+    /** 最近显示的画面和主时钟的偏差, 以及绝对值最大的一次 单位是微妙*/
+    std::atomic<int64_t> _avDrift{0}, _maxAvDrift{0};
+    /** 音频回调填充静音的次数*/
+    std::atomic<int> _aUnderruns{0};
+    /** 停止时写追踪事件的文件*/
+    QString _tracePath;
+
+    /** 视频解码线程模型*/
+    DecodeThreadType _decodeThreadType = ThreadAuto;
+    /** 视频解码线程数, 0自动*/
+    int _decodeThreadCount = 0;
+    /** 解码线程数上限, 0不限制*/
+    int _decodeThreadCap = 0;
+    /** 当前视频解码器实际协商的线程数和线程模型, 解码器打开、切换时记录, 界面线程不直接访问可能被释放的解码上下文*/
+    std::atomic<int> _activeDecodeThreadCount{0};
+    std::atomic<int> _activeDecodeThreadType{ThreadAuto};
 
+    /** 记录解码器实际协商的线程数和线程模型*/
+    void updateActiveDecodeThreads(AVCodecContext *decodeCxt);
     // 初始化解码器
-    int initDecoder(AVCodecContext **decodeCxt , AVMediaType type, AVStream **stream);
+    int initDecoder(AVFormatContext *fmtCxt, AVCodecContext **decodeCxt , AVMediaType type, AVStream **stream);
+    /** 画面是否按外部时钟显示*/
+    bool useExternalClock();
+    /** 音频时钟的当前时间 单位是秒, SDL还没回调过(无界面模式)用_aTime*/
+    double audioTime();
+    /** 发布音频时钟锚点(SDL回调调用, 不加锁)*/
+    void publishAudioAnchor(double time);
+    /** 把SDL回调最新发布的锚点设置到_aClock(读音频时钟前调用)*/
+    void syncAudioClock();
+    /** 清除音频时钟, 已经发布的锚点不再使用*/
+    void resetAudioClock();
     /** 设置播放状态 */
     void setState(State state);
+    /** 标记资源可以释放, 并唤醒等待释放的线程*/
+    void setCanFree(bool &canFree);
+    /** 打开文件创建解封装上下文, 开启内存映射读取时mmapIO返回映射对象*/
+    int openInput(const char *filename, AVFormatContext **fmtCxt, MmapIO **mmapIO);
     /** 读取文件*/
-    void readFile();
+    void readFile(int session);
+    /** 探测流信息, 快速启动时优先用缓存*/
+    int findStreamInfo(const char *filename, AVFormatContext *fmtCxt);
+    /** 初始化音视频, 快速启动时并行打开解码器*/
+    void initMediaInfo();
+    /** seek到_seekTime*/
+    int seekFile();
     /** 释放资源*/
     void free();
     void freeAudio();
     void freeVideo();
     /** 发生致命错误*/
     void fataError();
+    /** 清零吞吐量计数*/
+    void resetThroughput();
+    /** 打印各阶段吞吐量*/
+    void logThroughput();
 
 
     /**********视频方法************/
@@ -131,32 +407,84 @@ private:
     AVFrame *_vSwsInFrame = nullptr, *_vSwsOutFrame = nullptr;
     /** 视频格式数据转换的上下文*/
     SwsContext *_vSwsCxt = nullptr;
+    /** 像素格式转换输出缓冲池, sws_scale直接写进池里的内存, 显示完归还*/
+    AVBufferPool *_vSwsOutPool = nullptr;
+    /** 当前转换输出的缓冲*/
+    AVBufferRef *_vSwsOutBuf = nullptr;
+    /** 视频显示区域大小, 0是原始大小*/
+    std::atomic<int> _vDisplayWidth{0}, _vDisplayHeight{0};
+    /** 显示区域大小变了, 需要重建像素格式转换*/
+    std::atomic<bool> _vSwsDirty{false};
+    /** 高分辨率画面分条带并行转换*/
+    SliceScaler *_vScaler = nullptr;
+    /** 正在并行转换的帧的序号, 0是没有*/
+    int _vScaleGeneration = 0;
     /** 像素格式转换输出参数*/
     VideoSwsSpec _vSwsOutSpec;
     /** 视频seek到哪个时刻*/
     int64_t _vSeekTime = -1;
-    /** 时钟 记录当前pkt播放时间戳*/
+    /** seek后最多还能丢弃几帧, 按关键帧索引里GOP的帧数算, -1是不知道(没有索引)*/
+    std::atomic<int> _vSeekFrames{-1};
+    /** 视频关键帧索引*/
+    SeekIndex *_vSeekIndex = nullptr;
+    /** 时钟 记录当前解码出来的帧的显示时间戳*/
     double _vTime = 0;
-    /** 存放视频包列表*/
-    std::list<AVPacket> *_vPktList = nullptr;
-    /** 视频包列表互斥锁*/
-    CondMutex *_vMutex = nullptr;
+    /** 存放视频包队列*/
+    PktQueue *_vPktQueue = nullptr;
+    /** 解码并转换好等待显示的画面队列*/
+    FrameQueue *_vFrameQueue = nullptr;
+    /** 交给界面线程显示的画面信箱*/
+    FrameMailbox *_vMailbox = nullptr;
+    /** 解码线程看到的画面队列清空代数, 变了说明seek过, 要清掉解码器里缓存的旧帧*/
+    int _vFrameGeneration = 0;
+    /** 来不及显示丢弃的画面数*/
+    std::atomic<int> _vDropFrames{0};
+    /** 视频跟不上时按迟到情况降级*/
+    DegradeController *_vDegrade = nullptr;
+    /** 像素格式转换的缩放算法, 降级时换成更快的*/
+    int _vSwsFlags = SWS_BILINEAR;
     /** 视频资源是否可以释放*/
     bool _vCanFree = false;
+    /** 视频显示线程是否结束*/
+    bool _vPresentCanFree = false;
+    /** 读到文件尾部送空包后, 解码器里缓存的帧是否都取出来了*/
+    bool _vDrained = false;
     /** 是否有视频流*/
     bool _hasVideo = false;
 
 
     /** 初始化视频*/
     int initVideoInfo();
-    /** 添加视频包到列表*/
+    /** 打开解码器前按配置设置解码线程*/
+    void initDecodeThreads(AVCodecContext *decodeCxt, const AVCodec *decoder);
+    /** 添加视频包到队列*/
     void addVideoPkt(AVPacket &pkt);
-    /** 清除视频包列表*/
+    /** 放入空包, 解码线程取到后把解码器里缓存的帧都取出来*/
+    void addVideoDrainPkt();
+    /** 清除视频包队列*/
     void clearVideoList();
     /** 视频格式数据解码*/
     void decodervideo();
     /** 初始化视频格式转换*/
     int initSws();
+    /** 按输出参数创建输出缓冲池*/
+    int initSwsOutPool();
+    /** 显示区域大小变化后重建像素格式转换上下文和输出缓冲池*/
+    int resetSws();
+    /** 根据解码上下文计算输出参数并创建像素格式转换上下文*/
+    int initSwsCxt(AVCodecContext *decodeCxt, VideoSwsSpec &outSpec, SwsContext **swsCxt);
+    /** 按降级级别设置缩放算法、环路滤波和跳帧(视频解码线程调用)*/
+    void applyDegradeLevel();
+    /** 像素格式转换当前解码出来的帧*/
+    void scaleVideoFrame();
+    /** 把转换好的帧放入画面队列, immediate为true时显示线程不等待时钟*/
+    void queueVideoFrame(bool immediate);
+    /** 视频显示线程: 按时间戳对照音频时钟取出画面交给外界显示, 已经来不及的画面丢弃*/
+    void presentVideo();
+    /** 把画面交给外界显示*/
+    void presentVideoFrame(FrameQueue::Frame &frame);
+    /** 读包解码出第一帧画面先显示出来(快速启动)*/
+    int presentPoster();
 
 
     /**********音频方法************/
@@ -172,35 +500,73 @@ private:
     AVCodecContext *_aDecodeCxt = nullptr;
     /** 音频流*/
     AVStream *_aStream = nullptr;
-    /** 存放视频包列表*/
-    std::list<AVPacket> *_aPktList = nullptr;
-    /** 音频包列表互斥锁*/
-    CondMutex *_aMutex = nullptr;
+    /** 存放音频包队列*/
+    PktQueue *_aPktQueue = nullptr;
     /** 音频重采样上下文*/
     SwrContext *_aSwrCxt = nullptr;
+    /** 采样率不变时的专用格式转换, 有它就不用重采样上下文*/
+    SampleConverter::Func _aConvert = nullptr;
     /** 音频重采样输入\输出格式*/
     AudioResampleSpec _audioInSpec, _audioOutSpec;
     /** 音频重采样输入\输出Frame*/
     AVFrame *_aSwrInFrame = nullptr, *_aSwrOutFrame = nullptr;
-    /** 记录重采样后输出Frame的大小*/
+    /** 输出Frame能放多少个样本*/
+    int _aSwrOutSamples = 0;
+    /** 当前这段PCM数据, 重采样的输出, 不需要重采样时就是解码出来的Frame*/
+    const uint8_t *_aOutData = nullptr;
+    /** 音频设备, 0是没有打开*/
+    SDL_AudioDeviceID _aDevice = 0;
+    /** 和声卡协商好的音频设备参数*/
+    SDL_AudioSpec _aDeviceSpec;
+    /** 记录当前这段PCM数据的大小*/
     int _aSwrOutFrameSize = 0;
-    /** 重采样输出PCM数据的索引(从哪个位置开始取出PCM数据到SDL缓冲区的索引)*/
+    /** 重采样输出PCM数据的索引(从哪个位置开始把PCM数据写入环形缓冲的索引)*/
     int _aSwrOutFrameIdx = 0;
+    /** 音频解码线程和SDL回调之间的PCM环形缓冲, 无界面模式不用*/
+    PcmRing *_aRing = nullptr;
+    /** 环形缓冲写入末尾的时间戳*/
+    std::atomic<double> _aRingEndTime{0};
     /** 音频seek到哪个时刻*/
     int64_t _aSeekTime = -1;
-    /** 时钟 记录当前pkt播放时间戳*/
+    /** 时钟 记录最近一次SDL回调时听到的时间戳*/
     double _aTime = 0;
-    /** 视频资源是否可以释放*/
-    bool _aCanFree = false;
+    /** 音频时钟, 用SDL回调发布的锚点设置, 两次回调之间按单调时钟插值*/
+    MasterClock *_aClock = nullptr;
+    /**
+     * SDL回调发布的音频时钟锚点: 听到的时间戳和单调时钟时刻
+     * 顺序锁, 只有SDL回调写, 写的时候序号是奇数; 回调里不加锁, 读时钟的线程取出来设置_aClock
+     */
+    std::atomic<uint32_t> _aAnchorSeq{0};
+    std::atomic<double> _aAnchorTime{0};
+    std::atomic<int64_t> _aAnchorStamp{0};
+    /** _aClock已经用过的锚点序号, seek、停止后不再用之前的锚点*/
+    std::atomic<uint32_t> _aAnchorApplied{0};
+    /** 声卡延迟(从填充到听到) 单位是微妙*/
+    int64_t _aDeviceLatency = 0;
+    /** 记录当前解码的pkt时间戳, 比播放的时间戳早一个环形缓冲的时长*/
+    double _aDecodeTime = 0;
+    /** seek次数, 用来判断解码出的声音是不是seek之前的*/
+    std::atomic<int> _aSeekSerial{0};
+    /** 当前这段PCM数据解码时的seek次数、开头的时间戳、变速的速度(只有音频解码线程访问)*/
+    int _aChunkSerial = 0;
+    double _aChunkTime = 0;
+    double _aChunkSpeed = 1.0;
+    /** 变速不变调*/
+    TimeStretch *_aStretch = nullptr;
+    /** 上一段是否变速了, 变速缓存的数据对应的seek次数(只有音频解码线程访问)*/
+    bool _aStretching = false;
+    int _aStretchSerial = 0;
     /** 是否有音频流*/
     bool _hasAudio = false;
+    /** 音频解码线程是否结束*/
+    bool _aCanFree = false;
 
 
     /** 初始化音频*/
     int initAudioInfo();
-    /** 添加音频包到列表*/
+    /** 添加音频包到队列*/
     void addAudioPkt(AVPacket &pkt);
-    /** 清除音频包列表*/
+    /** 清除音频包队列*/
     void clearAudioList();
     /** 初始化SDL*/
     int initSDL();
@@ -208,10 +574,96 @@ private:
     static void audioSDLCallbackFunc(void *userdata, Uint8 * stream, int len);
     /** 实现SDL回调*/
     void audioSDLCallback(Uint8 * stream, int len);
+    /** 音频解码线程: 解码重采样后写入环形缓冲, 无界面模式全速解码交给输出*/
+    void pumpAudio();
     /** 音频包解码(返回解码后数据大小)*/
     int decoderAudio();
+    /** 转换_aSwrInFrame到输出格式, 数据在_aOutData(返回转换后数据大小)*/
+    int convertAudioFrame();
+    /** 按播放速度变速_aOutData里的size字节, 设置这段的时间戳, 返回变速后的大小(可能为0)*/
+    int stretchAudio(int size, int serial);
     /** 初始化重采样*/
     int initSwr();
+    /** 设置输出格式(交错存放, 声道布局取默认)*/
+    void setAudioOutSpec(int sampleRate, AVSampleFormat fmt, int chs);
+    /** 根据解码上下文设置输入参数并创建重采样上下文(输出参数用_audioOutSpec), 不需要重采样时找专用转换*/
+    int initSwrCxt(AVCodecContext *decodeCxt, AudioResampleSpec &inSpec,
+                   SwrContext **swrCxt, SampleConverter::Func *convert);
+    /** (重新)分配输出Frame的缓冲*/
+    int allocAudioOutBuffer(int samples);
+
+
+    /**********播放列表************/
+    // 预加载的下一个文件
+    // 切换时和播放器当前的资源互换, 切换完成后里面存放的是被换下来的上一个文件的资源
+    typedef struct {
+        /** 播放列表索引*/
+        int index;
+        char filename[512];
+        MmapIO *mmapIO;
+        AVFormatContext *fmtCxt;
+        AVStream *aStream;
+        AVCodecContext *aDecodeCxt;
+        SwrContext *aSwrCxt;
+        SampleConverter::Func aConvert;
+        AudioResampleSpec audioInSpec;
+        AVStream *vStream;
+        AVCodecContext *vDecodeCxt;
+        SwsContext *vSwsCxt;
+        VideoSwsSpec vSwsOutSpec;
+        /** 预读的包*/
+        std::vector<AVPacket> pkts;
+        /** 还有几个解码线程没有切换过来, 为0才能释放*/
+        std::atomic<int> refs;
+    } MediaItem;
+    /** 播放列表*/
+    QStringList _playlist;
+    /** 当前播放的索引*/
+    int _playlistIdx = 0;
+    /** 是否循环播放*/
+    bool _playlistLoop = false;
+    /** 第几次从停止开始播放, 读文件线程播放完毕后交给界面线程的重启用来判断用户是否已经停止或重新播放*/
+    std::atomic<int> _playSession{0};
+    /** 预加载好的下一个文件*/
+    MediaItem *_nextItem = nullptr;
+    /** 预加载线程*/
+    std::thread _preloadThread;
+    /** 等待音频\视频解码切换的文件(读文件线程放入, 解码线程遇到切换包取出)*/
+    std::list<MediaItem *> _aSwitchItems, _vSwitchItems;
+    /** 已经切换的文件, 存放换下来的资源, 解码线程都切换过来后由读文件线程释放*/
+    std::list<MediaItem *> _retiredItems;
+    /** 音频\视频解码切换了几次文件, 相等时才做音视频同步*/
+    int _aSerial = 0, _vSerial = 0;
+    /** 音频解码线程正在取出上一个文件解码器缓存的帧, 取完再切换; 开始取时的seek次数(只有音频解码线程访问)*/
+    bool _aSwitchDraining = false;
+    int _aSwitchDrainSerial = 0;
+    /** 读文件线程使用的音频\视频流索引, 切换文件时先于解码线程更新*/
+    int _aStreamIdx = -1, _vStreamIdx = -1;
+
+    /** 设置当前要播放的文件路径(不改变播放列表)*/
+    void loadFilename(const QString &filename);
+    /** 播放列表下一个索引, 没有返回-1*/
+    int nextPlaylistIndex();
+    /** 读文件线程正常播放完毕(在界面线程调用): 停止, 播放列表还有文件就打开下一个*/
+    void playNextItem(int session);
+    /** 开启后台线程预加载下一个文件*/
+    void startPreload();
+    /** 打开下一个文件、探测、打开解码器、创建转换上下文并预读一部分包*/
+    void preloadItem(int index);
+    /** 读到文件尾部时切换到预加载好的下一个文件, 不能无缝切换返回false*/
+    bool switchItem();
+    /** 放入切换文件的包, 解码线程取到后切换解码器*/
+    void addSwitchPkt(PktQueue *queue);
+    /** 是否切换文件的包*/
+    bool isSwitchPkt(AVPacket &pkt);
+    /** 音频解码切换到下一个文件(音频解码线程中调用, 只交换指针), 没有等待切换的文件返回false*/
+    bool switchAudioItem();
+    /** 视频解码切换到下一个文件, 没有等待切换的文件返回false*/
+    bool switchVideoItem();
+    /** 释放文件资源*/
+    void freeMediaItem(MediaItem *item);
+    /** 释放解码线程都已经切换过来的文件, all为true全部释放*/
+    void freeRetiredItems(bool all);
 
 
 
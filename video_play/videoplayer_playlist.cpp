@@ -0,0 +1,290 @@
+#include "videoplayer.h"
+#include <QDebug>
+#include <algorithm>
+#include <utility>
+
+// 预加载时预读多少个包, 切换后解码线程马上有数据可以解码
+#define PLAYLIST_PRELOAD_PKT_COUNT 32
+
+/**
+ * 播放列表: 当前文件播放时后台打开下一个文件(探测、解码器、转换上下文、预读包),
+ * 读到文件尾部时读文件线程直接换到下一个文件继续读, 在包队列里放入切换包,
+ * 音频\视频解码线程取到切换包时先取出当前解码器缓存的帧(重排序、帧线程和音频末尾的帧), 再换成下一个文件的解码器,
+ * SDL音频设备和解码线程都不重建.
+ */
+void VideoPlayer::setPlaylist(const QStringList &filenames) {
+    if (filenames.isEmpty()) return;
+    _playlist = filenames;
+    _playlistIdx = 0;
+    loadFilename(filenames.first());
+}
+
+int VideoPlayer::getPlaylistIndex() {
+    return _playlistIdx;
+}
+
+void VideoPlayer::setPlaylistLoop(bool loop) {
+    _playlistLoop = loop;
+}
+
+bool VideoPlayer::isPlaylistLoop() {
+    return _playlistLoop;
+}
+
+void VideoPlayer::loadFilename(const QString &filename) {
+    // 先保存toUtf8的结果, 临时对象释放后data()指向的内存就无效了
+    QByteArray name = filename.toUtf8();
+    int len = std::min(name.size(), (int)sizeof(_filename) - 1);
+    memcpy(_filename, name.constData(), len);
+    _filename[len] = '\0';
+}
+
+int VideoPlayer::nextPlaylistIndex() {
+    int next = _playlistIdx + 1;
+    if (next < _playlist.size()) return next;
+    return (_playlistLoop && !_playlist.isEmpty()) ? 0 : -1;
+}
+
+void VideoPlayer::playNextItem(int session) {
+    // 用户已经停止, 或者停止后又开始了新的播放, 这次播放完毕就不用处理了
+    if (session != _playSession || _state == Stopped) return;
+
+    // 没能无缝切换的下一个文件, 停止后重新打开
+    int next = nextPlaylistIndex();
+    stop();
+    if (next >= 0) {
+        _playlistIdx = next;
+        loadFilename(_playlist[next]);
+        play();
+    }
+}
+
+void VideoPlayer::startPreload() {
+    int index = nextPlaylistIndex();
+    if (index < 0) return;
+
+    if (_preloadThread.joinable()) {
+        _preloadThread.join();
+    }
+    _preloadThread = std::thread([this, index]() {
+        preloadItem(index);
+    });
+}
+
+void VideoPlayer::preloadItem(int index) {
+    MediaItem *item = new MediaItem();
+    item->index = index;
+    QByteArray name = _playlist[index].toUtf8();
+    int len = std::min(name.size(), (int)sizeof(item->filename) - 1);
+    memcpy(item->filename, name.constData(), len);
+    item->filename[len] = '\0';
+
+    // 打开文件, 探测流信息
+    int ret = openInput(item->filename, &item->fmtCxt, &item->mmapIO);
+    if (ret >= 0 && _state != Stopped) {
+        ret = findStreamInfo(item->filename, item->fmtCxt);
+    }
+    if (ret < 0 || _state == Stopped) {
+        qDebug() << "playlist preload error:" << item->filename;
+        freeMediaItem(item);
+        return;
+    }
+
+    // 打开解码器, 创建重采样\像素格式转换上下文, 某个流失败就当作没有这个流
+    if (initDecoder(item->fmtCxt, &item->aDecodeCxt, AVMEDIA_TYPE_AUDIO, &item->aStream) < 0
+            || initSwrCxt(item->aDecodeCxt, item->audioInSpec, &item->aSwrCxt, &item->aConvert) < 0) {
+        avcodec_free_context(&item->aDecodeCxt);
+        swr_free(&item->aSwrCxt);
+        item->aStream = nullptr;
+    }
+    if (initDecoder(item->fmtCxt, &item->vDecodeCxt, AVMEDIA_TYPE_VIDEO, &item->vStream) < 0
+            || initSwsCxt(item->vDecodeCxt, item->vSwsOutSpec, &item->vSwsCxt) < 0) {
+        avcodec_free_context(&item->vDecodeCxt);
+        sws_freeContext(item->vSwsCxt);
+        item->vSwsCxt = nullptr;
+        item->vStream = nullptr;
+    }
+
+    // 预读一部分包
+    int aStreamIdx = item->aStream ? item->aStream->index : -1;
+    int vStreamIdx = item->vStream ? item->vStream->index : -1;
+    AVPacket pkt;
+    while ((int)item->pkts.size() < PLAYLIST_PRELOAD_PKT_COUNT && _state != Stopped) {
+        if (av_read_frame(item->fmtCxt, &pkt) < 0) break;
+        if (pkt.stream_index == aStreamIdx || pkt.stream_index == vStreamIdx) {
+            item->pkts.push_back(pkt);
+        }else {
+            av_packet_unref(&pkt);
+        }
+    }
+
+    // 读文件线程切换前会先join预加载线程, 这里直接赋值
+    _nextItem = item;
+    qDebug() << "playlist preloaded" << index << item->filename;
+}
+
+bool VideoPlayer::switchItem() {
+    // 等待预加载完成
+    if (_preloadThread.joinable()) {
+        _preloadThread.join();
+    }
+    MediaItem *item = _nextItem;
+    if (!item) return false;
+    _nextItem = nullptr;
+
+    // SDL音频设备和视频解码线程都继续使用, 有没有音频\视频流要和当前文件一致才能无缝切换
+    if ((item->aStream != nullptr) != _hasAudio || (item->vStream != nullptr) != _hasVideo) {
+        qDebug() << "playlist item can not switch seamlessly:" << item->filename;
+        freeMediaItem(item);
+        return false;
+    }
+
+    // 解封装上下文只有读文件线程使用, 直接交换
+    std::swap(_fmtCxt, item->fmtCxt);
+    std::swap(_mmapIO, item->mmapIO);
+    std::swap(_filename, item->filename);
+    _aStreamIdx = _hasAudio ? item->aStream->index : -1;
+    _vStreamIdx = _hasVideo ? item->vStream->index : -1;
+    _playlistIdx = item->index;
+    if (_hasAudio) {
+        _aPktQueue->setTimeBase(item->aStream->time_base);
+    }
+    if (_hasVideo) {
+        _vPktQueue->setTimeBase(item->vStream->time_base);
+        _vSeekIndex->load(_filename, _vStreamIdx, item->vStream->time_base);
+    }
+
+    // 解码器由解码线程取到切换包时交换, 都换完才能释放换下来的资源
+    item->refs = (int)_hasAudio + (int)_hasVideo;
+    _stateMutex->lock();
+    if (_hasAudio) _aSwitchItems.push_back(item);
+    if (_hasVideo) _vSwitchItems.push_back(item);
+    _stateMutex->unlock();
+    _retiredItems.push_back(item);
+
+    if (_hasAudio) addSwitchPkt(_aPktQueue);
+    if (_hasVideo) addSwitchPkt(_vPktQueue);
+    // 预读的包跟在切换包后面
+    for (AVPacket &pkt : item->pkts) {
+        if (pkt.stream_index == _aStreamIdx) {
+            addAudioPkt(pkt);
+        }else {
+            addVideoPkt(pkt);
+        }
+    }
+    item->pkts.clear();
+
+    qDebug() << "playlist switch to" << _playlistIdx << _filename;
+    // 接着预加载下一个
+    startPreload();
+    return true;
+}
+
+void VideoPlayer::addSwitchPkt(PktQueue *queue) {
+    AVPacket pkt;
+    av_init_packet(&pkt);
+    pkt.data = nullptr;
+    pkt.size = 0;
+    pkt.stream_index = -1;
+    while (!queue->push(pkt) && _state != Stopped) {
+        queue->waitForSpace();
+    }
+}
+
+bool VideoPlayer::isSwitchPkt(AVPacket &pkt) {
+    return pkt.stream_index < 0 && !pkt.data;
+}
+
+bool VideoPlayer::switchAudioItem() {
+    _stateMutex->lock();
+    // seek后会重新放入切换包, 可能多出来, 没有等待切换的文件就忽略
+    if (_aSwitchItems.empty()) {
+        _stateMutex->unlock();
+        return false;
+    }
+    MediaItem *item = _aSwitchItems.front();
+    _aSwitchItems.pop_front();
+
+    std::swap(_aStream, item->aStream);
+    std::swap(_aDecodeCxt, item->aDecodeCxt);
+    std::swap(_aSwrCxt, item->aSwrCxt);
+    std::swap(_aConvert, item->aConvert);
+    std::swap(_audioInSpec, item->audioInSpec);
+    _aDecodeTime = 0;
+    _aSerial++;
+    // 唤醒等待音频切换的视频解码线程
+    _stateMutex->broadcast();
+    _stateMutex->unlock();
+    item->refs--;
+
+    // 界面刷新时长
+    emit videoInitFinished(this);
+    return true;
+}
+
+bool VideoPlayer::switchVideoItem() {
+    _stateMutex->lock();
+    if (_vSwitchItems.empty()) {
+        _stateMutex->unlock();
+        return false;
+    }
+    // 有音频时等音频先切换过去, 上一个文件剩下的画面和声音同步播完
+    while (_hasAudio && _aSerial <= _vSerial && _state != Stopped) {
+        _stateMutex->wait();
+    }
+    if (_state == Stopped) {
+        _stateMutex->unlock();
+        return false;
+    }
+    MediaItem *item = _vSwitchItems.front();
+    _vSwitchItems.pop_front();
+    _stateMutex->unlock();
+
+    std::swap(_vStream, item->vStream);
+    std::swap(_vDecodeCxt, item->vDecodeCxt);
+    updateActiveDecodeThreads(_vDecodeCxt);
+    std::swap(_vSwsCxt, item->vSwsCxt);
+    std::swap(_vSwsOutSpec, item->vSwsOutSpec);
+    // 输出大小变了重新创建像素格式转换输出的缓冲池
+    if (_vSwsOutSpec.size != item->vSwsOutSpec.size) {
+        initSwsOutPool();
+    }
+    _vTime = 0;
+
+    _stateMutex->lock();
+    _vSerial++;
+    _stateMutex->unlock();
+    item->refs--;
+
+    if (!_hasAudio) {
+        emit videoInitFinished(this);
+    }
+    return true;
+}
+
+void VideoPlayer::freeMediaItem(MediaItem *item) {
+    if (!item) return;
+
+    for (AVPacket &pkt : item->pkts) {
+        av_packet_unref(&pkt);
+    }
+    avcodec_free_context(&item->aDecodeCxt);
+    swr_free(&item->aSwrCxt);
+    avcodec_free_context(&item->vDecodeCxt);
+    sws_freeContext(item->vSwsCxt);
+    avformat_close_input(&item->fmtCxt);
+    // 自定义IO不会被avformat_close_input释放
+    delete item->mmapIO;
+    delete item;
+}
+
+void VideoPlayer::freeRetiredItems(bool all) {
+    for (auto it = _retiredItems.begin(); it != _retiredItems.end();) {
+        if (all || (*it)->refs == 0) {
+            freeMediaItem(*it);
+            it = _retiredItems.erase(it);
+        }else {
+            it++;
+        }
+    }
+}
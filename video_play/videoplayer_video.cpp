@@ -1,11 +1,26 @@
 #include "videoplayer.h"
+#include "yuv2rgb.h"
 #include <QDebug>
 #include <thread>
+#include <algorithm>
+#include <cstdlib>
+
+// 按外部时钟显示时, 离显示时刻还有多久之内改为精确睡眠 单位是微妙
+#define VIDEO_CLOCK_SLEEP_MARGIN 2000
+// 低延迟模式下画面晚于主时钟多少就丢弃 单位是秒
+#define VIDEO_LOW_LATENCY_DROP_THRESHOLD 0.015
+// 播放速度超过多少倍不解码非参考帧
+#define VIDEO_SKIP_NONREF_SPEED 2.0
 
 int VideoPlayer::initVideoInfo() {
     // 初始化解码器
-    int ret = initDecoder(&_vDecodeCxt, AVMEDIA_TYPE_VIDEO, &_vStream);
+    int ret = initDecoder(_fmtCxt, &_vDecodeCxt, AVMEDIA_TYPE_VIDEO, &_vStream);
     RET(initDecoder);
+    updateActiveDecodeThreads(_vDecodeCxt);
+    // 包队列按流的时间基换算缓存时长
+    _vPktQueue->setTimeBase(_vStream->time_base);
+    // 加载关键帧索引, 第一次打开的文件在后台建立
+    _vSeekIndex->load(_filename, _vStream->index, _vStream->time_base);
 
     // 初始化转格式(因为Qt平台渲染只支持rgba, yuv420->rgba)
     ret = initSws();
@@ -14,33 +29,60 @@ int VideoPlayer::initVideoInfo() {
     return 0;
 }
 
-void VideoPlayer::addVideoPkt(AVPacket &pkt) {
-    _vMutex->lock();
-    _vPktList->push_back(pkt);
-    _vMutex->signal();
-    _vMutex->unlock();
+void VideoPlayer::initDecodeThreads(AVCodecContext *decodeCxt, const AVCodec *decoder) {
+    // 线程数: 没指定也没有上限就是0, 交给ffmpeg按CPU核数自动选择(解码器还有自己的上限)
+    // 有上限时用指定的线程数, 没指定用检测到的核数, 再受每个播放器的上限约束
+    int count = _decodeThreadCount;
+    if (_decodeThreadCap > 0) {
+        if (count == 0) {
+            count = std::thread::hardware_concurrency();
+        }
+        // 取不到核数就用上限
+        count = count > 0 ? std::min(count, _decodeThreadCap) : _decodeThreadCap;
+    }
+    decodeCxt->thread_count = count;
+
+    // 线程模型: 解码器不支持的模型ffmpeg会自动退回单线程
+    switch (_decodeThreadType) {
+    case ThreadFrame:
+        decodeCxt->thread_type = FF_THREAD_FRAME;
+        break;
+    case ThreadSlice:
+        decodeCxt->thread_type = FF_THREAD_SLICE;
+        break;
+    default:
+        decodeCxt->thread_type = (decoder->capabilities & AV_CODEC_CAP_FRAME_THREADS)
+                ? FF_THREAD_FRAME : FF_THREAD_SLICE;
+        break;
+    }
 }
 
-int VideoPlayer::initSws() {
-    // 宽高16的倍数
-    int inW = _vDecodeCxt->width;
-    int inH = _vDecodeCxt->height;
+void VideoPlayer::addVideoPkt(AVPacket &pkt) {
+    // 槽位用完了挂起等待空位(切换播放列表时会一次放入多个预读的包)
+    while (!_vPktQueue->push(pkt)) {
+        if (_state == Stopped) {
+            av_packet_unref(&pkt);
+            return;
+        }
+        _vPktQueue->waitForSpace();
+    }
+}
 
-    // 像素格式转换输出参数
-    _vSwsOutSpec.width = inW >> 4 << 4;
-    _vSwsOutSpec.height = inH >> 4 << 4;
-    _vSwsOutSpec.pixelFmt = AV_PIX_FMT_RGB24;
-    _vSwsOutSpec.size = av_image_get_buffer_size(_vSwsOutSpec.pixelFmt, _vSwsOutSpec.width, _vSwsOutSpec.height, 1);
+void VideoPlayer::addVideoDrainPkt() {
+    // 和切换包的区别是流索引有效, 解码线程照常送进解码器, 空包让解码器进入取出缓存帧的状态
+    AVPacket pkt;
+    av_init_packet(&pkt);
+    pkt.data = nullptr;
+    pkt.size = 0;
+    pkt.stream_index = _vStreamIdx;
+    addVideoPkt(pkt);
+}
 
+int VideoPlayer::initSws() {
     // 获取像素数据格式转换上下文
-    _vSwsCxt = sws_getContext(inW, inH, _vDecodeCxt->pix_fmt,
-                              _vSwsOutSpec.width, _vSwsOutSpec.height, _vSwsOutSpec.pixelFmt,
-                              // flags参数为选择哪个图片scale算法,参考官方源码怎么传的, 查询资料SWS_BICUBIC 这个性能好点
-                              SWS_BILINEAR, nullptr, nullptr, nullptr);
-    if (!_vSwsCxt) {
-        qDebug() << "sws_getContext error";
-        return -1;
-    }
+    int ret = initSwsCxt(_vDecodeCxt, _vSwsOutSpec, &_vSwsCxt);
+    RET(initSwsCxt);
+
     // 初始化Frame
     _vSwsInFrame = av_frame_alloc();
     if (!_vSwsInFrame) {
@@ -54,51 +96,142 @@ int VideoPlayer::initSws() {
         return -1;
     }
 
-    // 初始化_vSwsOutFrame->data[0]指向的内存区, 接受转换数据
-    av_image_alloc(_vSwsOutFrame->data,
-                   _vSwsOutFrame->linesize,
-                   _vSwsOutSpec.width,
-                   _vSwsOutSpec.height,
-                   _vSwsOutSpec.pixelFmt, 1);
+    qDebug() << "yuv2rgb simd:" << Yuv2Rgb::isaName(Yuv2Rgb::isa());
+
+    // _vSwsOutFrame->data指向缓冲池取出的内存, 每帧转换前再设置
+    return initSwsOutPool();
+}
+
+int VideoPlayer::initSwsOutPool() {
+    // 已经发出去的缓冲还在被外界引用, 等它们都归还后旧的缓冲池才真正释放
+    av_buffer_pool_uninit(&_vSwsOutPool);
+    _vSwsOutPool = av_buffer_pool_init(_vSwsOutSpec.size, av_buffer_alloc);
+    if (!_vSwsOutPool) {
+        qDebug() << "av_buffer_pool_init error";
+        return -1;
+    }
+    return 0;
+}
+
+int VideoPlayer::initSwsCxt(AVCodecContext *decodeCxt,
+                            VideoSwsSpec &outSpec,
+                            SwsContext **swsCxt) {
+    int inW = decodeCxt->width;
+    int inH = decodeCxt->height;
+
+    // 输出大小: 显示区域比视频小就按视频宽高比缩放到显示区域, 转换和缩放一次完成,
+    // 显示时不再需要QPainter缩放
+    int outW = inW;
+    int outH = inH;
+    int displayW = _vDisplayWidth;
+    int displayH = _vDisplayHeight;
+    if (displayW > 0 && displayH > 0 && (outW > displayW || outH > displayH)) {
+        if ((int64_t)outW * displayH > (int64_t)displayW * outH) {
+            outH = (int64_t)displayW * outH / outW;
+            outW = displayW;
+        }else {
+            outW = (int64_t)displayH * outW / outH;
+            outH = displayH;
+        }
+    }
+
+    // 像素格式转换输出参数
+    // 宽16的倍数, 每行起始地址按64字节对齐, 高取偶数
+    outSpec.width = std::max(outW >> 4 << 4, 16);
+    outSpec.height = std::max(outH >> 1 << 1, 2);
+    // 32位格式和Qt的QImage::Format_RGB32内存布局一致, 绘制时走对齐的快速路径
+    outSpec.pixelFmt = AV_PIX_FMT_RGB32;
+    outSpec.size = av_image_get_buffer_size(outSpec.pixelFmt, outSpec.width, outSpec.height, 1);
 
+    // 获取像素数据格式转换上下文
+    *swsCxt = sws_getContext(inW, inH, decodeCxt->pix_fmt,
+                             outSpec.width, outSpec.height, outSpec.pixelFmt,
+                             // flags参数为选择哪个图片scale算法,参考官方源码怎么传的, 查询资料SWS_BICUBIC 这个性能好点
+                             // 降级时换成更快的算法
+                             _vSwsFlags, nullptr, nullptr, nullptr);
+    if (!*swsCxt) {
+        qDebug() << "sws_getContext error";
+        return -1;
+    }
     return 0;
 }
 
+int VideoPlayer::resetSws() {
+    SwsContext *swsCxt = nullptr;
+    VideoSwsSpec outSpec;
+    int ret = initSwsCxt(_vDecodeCxt, outSpec, &swsCxt);
+    RET(initSwsCxt);
+
+    sws_freeContext(_vSwsCxt);
+    _vSwsCxt = swsCxt;
+    bool sizeChanged = outSpec.size != _vSwsOutSpec.size;
+    _vSwsOutSpec = outSpec;
+    qDebug() << "video output size" << _vSwsOutSpec.width << _vSwsOutSpec.height;
+    return sizeChanged ? initSwsOutPool() : 0;
+}
+
 void VideoPlayer::decodervideo() {
+    TRACE_THREAD("video decode");
 
     while (true) {
-        // 视频暂停 如果没有seek操作continue
-        if (_state == Paused  && _vSeekTime == -1) {
-            continue;
+        // 视频暂停 如果没有seek操作挂起等待, 播放、停止、seek时会被唤醒
+        _stateMutex->lock();
+        while (_state == Paused && _vSeekTime == -1) {
+            _stateMutex->wait();
         }
+        _stateMutex->unlock();
 
         if (_state == Stopped) {
             // 标记视频资源可以释放
-            _vCanFree = true;
+            setCanFree(_vCanFree);
             break;
         }
 
-        _vMutex->lock();
-        // 获取视频包
-        if (_vPktList->empty()) {
-            _vMutex->unlock();
+        // 获取视频包, 没有包挂起等待读文件线程放入
+        AVPacket pkt;
+        if (!_vPktQueue->pop(pkt)) {
+            _vPktQueue->waitForData();
             continue;
         }
+        // 播放列表切换到下一个文件: 切换包也是空包, 照常送进解码器取出缓存的帧, 取完再换解码器
+        bool switching = isSwitchPkt(pkt);
+        // seek清空了画面队列, 解码器里还缓存着seek前的帧, 一起清掉
+        int generation = _vFrameQueue->generation();
+        if (generation != _vFrameGeneration) {
+            avcodec_flush_buffers(_vDecodeCxt);
+            _vFrameGeneration = generation;
+        }
+
+        // 按降级级别设置环路滤波和跳帧
+        applyDegradeLevel();
+        // 拖动进度条中只解码关键帧
+        if (_scrubbing) {
+            _vDecodeCxt->skip_frame = AVDISCARD_NONKEY;
+        }
+        // 高倍速播放不解码非参考帧, 解码跟得上时钟; 无界面模式要输出每一帧
+        if (!_sink && _speed > VIDEO_SKIP_NONREF_SPEED) {
+            _vDecodeCxt->skip_frame = std::max(_vDecodeCxt->skip_frame, AVDISCARD_NONREF);
+        }
 
-        AVPacket pkt = _vPktList->front();
-        _vPktList->pop_front();
-        _vMutex->unlock();
-        // 视频时钟
-        if (pkt.pts != AV_NOPTS_VALUE) {
-            _vTime = av_q2d(_vStream->time_base) * pkt.pts;
+        // seek时早于seek时刻的帧最后都要丢弃, 其中的非参考帧不影响后面的帧, 让解码器直接跳过不解码
+        double pktTime = pkt.pts != AV_NOPTS_VALUE ? av_q2d(_vStream->time_base) * pkt.pts : _vTime;
+        if (_vSeekTime >= 0 && pktTime < _vSeekTime) {
+            _vDecodeCxt->skip_frame = std::max(_vDecodeCxt->skip_frame, AVDISCARD_NONREF);
         }
 
-        // 发送数据到解码器
+        // 发送数据到解码器, 空包是读到文件尾部后要取出解码器里缓存的帧
+        bool drain = !pkt.data;
+        int64_t decodeStart = av_gettime_relative();
+        TRACE_BEGIN("send packet", pktTime);
         int ret = avcodec_send_packet(_vDecodeCxt, &pkt);
+        TRACE_END("send packet", pktTime);
 
         // 释放pkt
         av_packet_unref(&pkt);
-        CONTINUE(avcodec_send_packet);
+        // 切换包送不进去(解码器已经在取缓存帧的状态)也要接着切换
+        if (!switching) {
+            CONTINUE(avcodec_send_packet);
+        }
 
         // 相对音频,这里可以用循环
         while(true) {
@@ -110,11 +243,23 @@ void VideoPlayer::decodervideo() {
              * 又由于是最后解码数据了,函数会读一次看看是不是真到数据末尾了, 没有解码数据了ret就返回AVERROR_EOF,
              * 同时也释放了上次_vSwsInFrame->data.所以data不需要我们创建不需要手动释放
             */
+            TRACE_BEGIN("receive frame", -1);
             ret = avcodec_receive_frame(_vDecodeCxt, _vSwsInFrame);
+            TRACE_END("receive frame", -1);
             if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
                 break;
             }else BREAK(avcodec_receive_frame);
-
+            // 解码耗时, 一个包解码出多帧时从上一帧处理完算起
+            int64_t decodeTime = av_gettime_relative() - decodeStart;
+            _throughput.videoDecodeTime += decodeTime;
+            _throughput.videoDecodeFrames++;
+            _stageTimes[StageDecode].record(decodeTime);
+
+            // 视频时钟用帧的显示时间戳, 有B帧时包的pts和解码出来的帧顺序不一致
+            int64_t pts = _vSwsInFrame->best_effort_timestamp;
+            if (pts != AV_NOPTS_VALUE) {
+                _vTime = av_q2d(_vStream->time_base) * pts;
+            }
 
             /* 每次seek操作, ffmpeg都会从seek时间GOP对应的I帧开始, 然后不断解码到seek对应的时间帧(可能是B帧/p帧, 或者刚好是I帧)
              * 根据h264原理, 如果是B帧或者P帧就从他们的参考帧开始解码, 所以不可避免有早于seek时间的视频包, 这些视频包我们作丢弃处理.
@@ -122,76 +267,368 @@ void VideoPlayer::decodervideo() {
              * 还有一点: 根据h264原理, 必须要做解码后判断丢弃包的时间, 如果avcodec_send_packet前判断丢弃, 之后的解码帧没有了前面的
              * 参考帧会出现画面撕裂.
              */
-            // 发现视频的pkt包时钟比_vSeekTime还早就丢掉
+            // 发现视频帧的时钟比_vSeekTime还早就丢掉
+            bool seekFrame = false;
             if (_vSeekTime >= 0) {
-                // 小于seek时钟的帧丢掉
-                if (_vTime < _vSeekTime) {
-                    av_packet_unref(&pkt);
+                // 小于seek时钟的帧丢掉; 有关键帧索引时丢弃的帧数不超过GOP的帧数, 时间戳有问题也不会一直丢到下一个GOP
+                if (_vTime < _vSeekTime && _vSeekFrames != 0) {
+                    if (_vSeekFrames > 0) {
+                        _vSeekFrames--;
+                    }
+                    TRACE_INSTANT("seek skip", _vTime);
+                    decodeStart = av_gettime_relative();
                     continue;
                 }else {
                     _vSeekTime = -1;
+                    _vSeekFrames = -1;
+                    seekFrame = true;
                 }
             }
 
-            // 像素格式转换
-            sws_scale(_vSwsCxt,
-                      _vSwsInFrame->data, _vSwsInFrame->linesize,
-                      // 从哪里开始读取数据, 0代表从第一行开始
-                      0,
-                      _vDecodeCxt->height,
-                      _vSwsOutFrame->data, _vSwsOutFrame->linesize);
-
-            if (_hasAudio) {// 有音频
-                // 如果视频包过早被解码出来, 那需要等待对应的音频时刻到达
-                while (_vTime > _aTime && _state == Playing && _aPktList->size() != 0) {
-//                    SDL_Delay(5);
-                }
-            }else {
-                // TODO
+            // 像素格式转换, 高分辨率时在工作线程并行转换
+            scaleVideoFrame();
+
+            // 放入画面队列, 由显示线程按时间戳交给外界显示, 解码线程不再等待音频时钟, 接着解码后面的帧
+            // seek后的第一帧立即显示(暂停时seek也要显示出seek位置的画面)
+            queueVideoFrame(seekFrame);
+            decodeStart = av_gettime_relative();
+        }
 
+        // 多出来的切换包没有切换, 解码器要恢复到能接着送包的状态
+        if (switching) {
+            if (!switchVideoItem()) {
+                avcodec_flush_buffers(_vDecodeCxt);
             }
+        }else if (drain) {
+            // 缓存的帧都取出来了, 通知读文件线程
+            setCanFree(_vDrained);
+        }
+    }
+}
+
+void VideoPlayer::applyDegradeLevel() {
+    int level = _vDegrade->level();
+    // 1级: 缩放换成更快的算法, 下一帧转换前重建
+    int swsFlags = level >= DegradeFastScale ? SWS_FAST_BILINEAR : SWS_BILINEAR;
+    if (swsFlags != _vSwsFlags) {
+        _vSwsFlags = swsFlags;
+        _vSwsDirty = true;
+    }
+    // 2级: 跳过环路滤波, 画面有块效应但解码快很多
+    _vDecodeCxt->skip_loop_filter = level >= DegradeSkipLoopFilter ? AVDISCARD_ALL : AVDISCARD_DEFAULT;
+    // 3级: 不解码非参考帧; 4级: 只解码关键帧
+    if (level >= DegradeKeyFrameOnly) {
+        _vDecodeCxt->skip_frame = AVDISCARD_NONKEY;
+    }else if (level >= DegradeSkipNonRef) {
+        _vDecodeCxt->skip_frame = AVDISCARD_NONREF;
+    }else {
+        _vDecodeCxt->skip_frame = AVDISCARD_DEFAULT;
+    }
+}
 
-            // 复制解码好的视频帧给新的内存区, 不直接传_vSwsOutFrame->data[0]地址出去,
-            // 防止像素转换线程在调用sws_scale过程中写入新数据到_vSwsOutFrame->data[0],
-            // 而外界渲染主线程渲染时又在读取_vSwsOutFrame->data[0]指向的内存区数据, 读到未完成转换的数据导致出错
-            // 出bug: emit videoPlayFrameDecoded(this, _vSwsOutFrame->data[0], _vSwsOutSpec);
+void VideoPlayer::scaleVideoFrame() {
+    TRACE_SCOPE("scale", _vTime);
+    // 等上一帧的并行转换完成(它和这一帧的解码重叠进行), 之后才能重建转换、从缓冲池取内存
+    if (_vScaleGeneration) {
+        _vScaler->wait();
+        _vScaleGeneration = 0;
+        _throughput.videoScaleTime += _vScaler->lastTime();
+        _stageTimes[StageScale].record(_vScaler->lastTime());
+    }
+
+    // 显示区域大小变了, 按新的大小重建转换
+    if (_vSwsDirty.exchange(false)) {
+        resetSws();
+    }
+
+    // 从缓冲池取一块内存, sws_scale直接写进去, 不再额外拷贝
+    // 每帧都是不同的缓冲, 外界显示上一帧时不会读到正在转换的数据
+    av_buffer_unref(&_vSwsOutBuf);
+    _vSwsOutBuf = av_buffer_pool_get(_vSwsOutPool);
+    if (!_vSwsOutBuf) {
+        qDebug() << "av_buffer_pool_get error";
+        return;
+    }
+    av_image_fill_arrays(_vSwsOutFrame->data, _vSwsOutFrame->linesize,
+                         _vSwsOutBuf->data,
+                         _vSwsOutSpec.pixelFmt,
+                         _vSwsOutSpec.width,
+                         _vSwsOutSpec.height, 1);
+
+    // 画面够大就交给工作线程并行转换, 这里立即返回, 显示线程显示前再等待这一帧转换完成
+    int slices = SliceScaler::sliceCount(_vDecodeCxt->height, _vSwsOutSpec.height);
+    if (slices > 1) {
+        bool ready = _vScaler->isMatch(_vDecodeCxt->width, _vDecodeCxt->height, _vDecodeCxt->pix_fmt,
+                                       _vSwsOutSpec.width, _vSwsOutSpec.height, _vSwsOutSpec.pixelFmt,
+                                       _vSwsFlags)
+                || _vScaler->init(_vDecodeCxt->width, _vDecodeCxt->height, _vDecodeCxt->pix_fmt,
+                                  _vSwsOutSpec.width, _vSwsOutSpec.height, _vSwsOutSpec.pixelFmt,
+                                  _vSwsFlags, slices) >= 0;
+        if (ready) {
+            _vScaleGeneration = _vScaler->start(_vSwsInFrame, _vSwsOutFrame->data, _vSwsOutFrame->linesize);
+            if (_vScaleGeneration > 0) return;
+            _vScaleGeneration = 0;
+        }
+    }
+
+    int64_t scaleStart = av_gettime_relative();
+    // 不缩放的常见格式用SIMD专用转换, 其他情况回退到sws_scale
+    bool direct = _vSwsOutSpec.width == _vDecodeCxt->width
+            && _vSwsOutSpec.height == _vDecodeCxt->height
+            && _vSwsOutSpec.pixelFmt == AV_PIX_FMT_RGB32
+            && Yuv2Rgb::convert(_vSwsInFrame, 0, _vDecodeCxt->height,
+                                _vSwsOutFrame->data[0], _vSwsOutFrame->linesize[0]);
+    if (!direct) {
+        sws_scale(_vSwsCxt,
+                  _vSwsInFrame->data, _vSwsInFrame->linesize,
+                  // 从哪里开始读取数据, 0代表从第一行开始
+                  0,
+                  _vDecodeCxt->height,
+                  _vSwsOutFrame->data, _vSwsOutFrame->linesize);
+    }
+    int64_t scaleTime = av_gettime_relative() - scaleStart;
+    _throughput.videoScaleTime += scaleTime;
+    _stageTimes[StageScale].record(scaleTime);
+}
+
+void VideoPlayer::queueVideoFrame(bool immediate) {
+    if (!_vSwsOutBuf) return;
+    TRACE_SCOPE("queue frame", _vTime);
+    _throughput.videoScaleFrames++;
+
+    // 缓冲的引用交给画面队列, 画面的参数跟着一起放入(播放列表切换后输出大小可能不同)
+    FrameQueue::Frame frame;
+    frame.buf = _vSwsOutBuf;
+    frame.width = _vSwsOutSpec.width;
+    frame.height = _vSwsOutSpec.height;
+    frame.pixelFmt = _vSwsOutSpec.pixelFmt;
+    frame.size = _vSwsOutSpec.size;
+    frame.pts = _vTime;
+    frame.serial = _vSerial;
+    frame.generation = _vFrameGeneration;
+    frame.immediate = immediate;
+    frame.queuedTime = av_gettime_relative();
+    // 还在并行转换就先放入队列, 解码线程接着解码下一帧
+    frame.scaleGeneration = _vScaleGeneration;
+    _vSwsOutBuf = nullptr;
+
+    // 队列满了挂起等待显示线程取走, 停止时直接释放
+    while (!_vFrameQueue->push(frame)) {
+        if (_state == Stopped) {
+            av_buffer_unref(&frame.buf);
+            return;
+        }
+        _vFrameQueue->waitForSpace();
+    }
 
-            // 将像素数据转换后, 拷贝一份出来
-            uint8_t *data = (uint8_t *)av_malloc(_vSwsOutSpec.size);
-            memcpy(data, _vSwsOutFrame->data[0], _vSwsOutSpec.size);
-            emit videoPlayFrameDecoded(this, data, _vSwsOutSpec);
+    // 唤醒等待画面的显示线程
+    _stateMutex->lock();
+    _stateMutex->broadcast();
+    _stateMutex->unlock();
+}
+
+void VideoPlayer::presentVideo() {
+    TRACE_THREAD("video present");
+    FrameQueue::Frame frame, next;
+    while (true) {
+        // 等待画面, 暂停时只显示需要立即显示的画面
+        // 放入画面、播放、暂停、停止、seek时会被唤醒
+        _stateMutex->lock();
+        while (_state != Stopped
+               && !(_vFrameQueue->peek(frame) && (_state == Playing || frame.immediate))) {
+            _stateMutex->wait();
+        }
+        if (_state == Stopped) {
+            _stateMutex->unlock();
+            // 标记显示线程结束
+            setCanFree(_vPresentCanFree);
+            break;
+        }
+
+        // 外部时钟: 新文件的第一帧、seek后的第一帧重新设置锚点
+        if (frame.immediate || !_extClock->isSet() || frame.serial != _extClockSerial) {
+            _extClock->set(frame.pts);
+            _extClockSerial = frame.serial;
+        }
+
+        // 主时钟: 有音频默认用音频时钟, 没有音频或者设置了外部时钟用外部时钟
+        // 播放列表切换时音频已经换到下一个文件, 两个时钟不是同一个文件的不做同步
+        // 无界面模式不等待时钟, 也不丢帧
+        bool external = useExternalClock();
+        bool sync = !_sink && !frame.immediate && (external || (_hasAudio && frame.serial == _aSerial));
+        double master = external ? _extClock->time() : audioTime();
+        // 音频时钟在SDL回调之间插值, SDL回调过之后和外部时钟一样按时刻精确等待
+        MasterClock *clock = external ? _extClock : _aClock;
+        if (sync && clock->isSet()) {
+            int64_t deadline = clock->deadline(frame.pts);
+            int64_t delay = deadline - MasterClock::now();
+            if (deadline >= 0 && delay > VIDEO_CLOCK_SLEEP_MARGIN) {
+                // 离显示时刻还远, 可以被唤醒地定时挂起, 提前一点醒来
+                _stateMutex->waitTimeout((Uint32)((delay - VIDEO_CLOCK_SLEEP_MARGIN) / 1000) + 1);
+                _stateMutex->unlock();
+                continue;
+            }
+            if (deadline >= 0 && delay > 0) {
+                // 最后一小段按绝对时刻精确睡眠, 再重新判断一次
+                _stateMutex->unlock();
+                MasterClock::sleepUntil(deadline);
+                continue;
+            }
+        }else if (sync && !external && frame.pts > master && !_aPktQueue->isEmpty()) {
+            // 画面的时刻还没到, 按两个时钟的差值(换算成实际时间)定时挂起
+            // 醒来后可能暂停、停止、seek或者放入了新画面, 重新判断
+            _stateMutex->waitTimeout((Uint32)((frame.pts - master) / _speed * 1000) + 1);
+            _stateMutex->unlock();
+            continue;
+        }
 
-            qDebug() << "渲染了一帧" << _vTime << _aTime;
+        // 下一帧的时刻也已经过了, 这一帧来不及显示直接丢弃, 追上主时钟
+        // 低延迟模式晚了一点就丢, 不等下一帧也到时刻
+        // 没有下一帧时next是上一次的内容, 不能拿来判断
+        bool headroom = _vFrameQueue->peek(next, 1) && next.serial == frame.serial;
+        if (sync && headroom
+                && (next.pts <= master
+                    || (_lowLatency && master - frame.pts > VIDEO_LOW_LATENCY_DROP_THRESHOLD))) {
+            if (_vFrameQueue->pop(frame)) {
+                av_buffer_unref(&frame.buf);
+                _vDropFrames++;
+                TRACE_INSTANT("drop", frame.pts);
+            }
+            _vDegrade->update(master - frame.pts, true, headroom);
+            _stateMutex->unlock();
+            continue;
+        }
 
+        // 迟到多少、解码有没有余量交给降级控制, 记录音画偏差
+        if (sync) {
+            _vDegrade->update(master - frame.pts, false, headroom);
+            int64_t drift = (frame.pts - master) * 1000000;
+            _avDrift = drift;
+            if (std::abs(drift) > std::abs((int64_t)_maxAvDrift)) {
+                _maxAvDrift = drift;
+            }
+            TRACE_COUNTER("av drift(ms)", drift / 1000.0);
         }
+        bool popped = _vFrameQueue->pop(frame);
+        _stateMutex->unlock();
+        TRACE_COUNTER("frame queue", _vFrameQueue->size());
+        TRACE_COUNTER("video pkt queue", _vPktQueue->size());
+        TRACE_COUNTER("audio pkt queue", _aPktQueue->size());
+        if (popped) {
+            _stageTimes[StageQueueWait].record(av_gettime_relative() - frame.queuedTime);
+            // 放入时还没转换完, 显示前等这一帧转换完成
+            if (frame.scaleGeneration) {
+                _vScaler->wait(frame.scaleGeneration);
+            }
+            presentVideoFrame(frame);
+        }
+    }
+}
+
+void VideoPlayer::presentVideoFrame(FrameQueue::Frame &frame) {
+    TRACE_SCOPE("present", frame.pts);
+    // 无界面模式交给输出, 写完直接归还缓冲
+    if (_sink) {
+        int64_t outputStart = av_gettime_relative();
+        _sink->writeVideo(frame.buf->data, frame.size,
+                          frame.width, frame.height, frame.pixelFmt, frame.pts);
+        av_buffer_unref(&frame.buf);
+        int64_t outputTime = av_gettime_relative() - outputStart;
+        _throughput.videoOutputTime += outputTime;
+        _throughput.videoOutputFrames++;
+        _stageTimes[StageHandoff].record(outputTime);
+        return;
+    }
+
+    // 把缓冲的引用放进信箱, 界面线程取走显示完释放引用, 缓冲回到缓冲池
+    // 稳定播放时缓冲池里只有几块内存在循环使用, 不再每帧av_malloc + memcpy
+    // 界面线程卡住时信箱里只留最新的一帧, 不会在事件队列里堆积
+    frame.queuedTime = av_gettime_relative();
+    if (_vMailbox->post(frame)) {
+        emit videoFrameAvailable(this);
+    }
+
+    // 统计从play到显示第一帧画面的耗时
+    if (_firstFrameTime < 0) {
+        int64_t firstFrameTime = av_gettime_relative() - _openTime;
+        _firstFrameTime = firstFrameTime;
+        qDebug() << "first frame time(ms):" << firstFrameTime / 1000;
+    }
 
+    // 没有音频时由显示线程通知播放时间变化
+    if (!_hasAudio) {
+        emit timeChanged(this);
     }
 }
 
-void VideoPlayer::clearVideoList() {
-    _vMutex->lock();
-    for(AVPacket &pkt : *_vPktList) {
+int VideoPlayer::presentPoster() {
+    // 读包直到解码出第一帧画面, 音频包照常放进队列, 之后解码线程接着解码后面的包
+    AVPacket pkt;
+    while (_state != Stopped && !_aPktQueue->isFull()) {
+        int ret = av_read_frame(_fmtCxt, &pkt);
+        RET(av_read_frame);
+
+        if (_hasAudio && pkt.stream_index == _aStream->index) {
+            addAudioPkt(pkt);
+            continue;
+        }
+        if (pkt.stream_index != _vStream->index) {
+            av_packet_unref(&pkt);
+            continue;
+        }
+
+        ret = avcodec_send_packet(_vDecodeCxt, &pkt);
         av_packet_unref(&pkt);
+        RET(avcodec_send_packet);
+
+        ret = avcodec_receive_frame(_vDecodeCxt, _vSwsInFrame);
+        if (ret == AVERROR(EAGAIN)) continue;
+        RET(avcodec_receive_frame);
+
+        int64_t pts = _vSwsInFrame->best_effort_timestamp;
+        if (pts != AV_NOPTS_VALUE) {
+            _vTime = av_q2d(_vStream->time_base) * pts;
+        }
+        scaleVideoFrame();
+        queueVideoFrame(true);
+        return 0;
     }
-    _vPktList->clear();
-    _vMutex->unlock();
+    return -1;
+}
+
+void VideoPlayer::clearVideoList() {
+    // 先清包再清画面, 清空画面队列之后解码线程取到的都是新的包
+    _vPktQueue->clear();
+    _vFrameQueue->clear();
 }
 
 void VideoPlayer::freeVideo() {
 
     clearVideoList();
+    _vMailbox->clear();
+    _vSeekIndex->cancel();
     avcodec_free_context(&_vDecodeCxt);
+    // 先停掉并行转换的工作线程, 它们还在读写下面的帧
+    _vScaler->free();
+    _vScaleGeneration = 0;
     av_frame_free(&_vSwsInFrame);
-    if (_vSwsOutFrame) {
-        av_freep(&_vSwsOutFrame->data[0]);
-        av_frame_free(&_vSwsOutFrame);
-    }
+    av_frame_free(&_vSwsOutFrame);
+    av_buffer_unref(&_vSwsOutBuf);
+    _vFrameGeneration = _vFrameQueue->generation();
+    av_buffer_pool_uninit(&_vSwsOutPool);
     sws_freeContext(_vSwsCxt);
     _vSwsCxt = nullptr;
     _vStream = nullptr;
     _vTime = 0;
     _vSeekTime = -1;
+    _vSeekFrames = -1;
+    updateActiveDecodeThreads(nullptr);
     _hasVideo = false;
     _vCanFree = false;
+    _vPresentCanFree = false;
+    _vDrained = false;
+    _vDropFrames = 0;
+    _vDegrade->reset();
+    _vSwsFlags = SWS_BILINEAR;
 
 }
@@ -1,10 +1,21 @@
 #include "videoslider.h"
 #include <QMouseEvent>
 #include <QStyle>
+#include <QPixmap>
 
 VideoSlider::VideoSlider(QWidget *parent) : QSlider(parent)
 {
+    // 拖动和松开转发出去, 外界拖动时只显示关键帧, 松开再精确seek
+    connect(this, &QSlider::sliderMoved, [this]() {
+        emit dragged(this);
+    });
+    connect(this, &QSlider::sliderReleased, [this]() {
+        emit released(this);
+    });
 
+    // 悬停预览: 不按下鼠标也要收到移动事件
+    setMouseTracking(true);
+    _preview = new QLabel(this, Qt::ToolTip | Qt::FramelessWindowHint);
 }
 
 void VideoSlider::mousePressEvent(QMouseEvent *ev) {
@@ -26,3 +37,52 @@ void VideoSlider::mousePressEvent(QMouseEvent *ev) {
     // 点击事件
     emit clicked(this);
 }
+
+void VideoSlider::mouseMoveEvent(QMouseEvent *ev) {
+    QSlider::mouseMoveEvent(ev);
+    // 拖动时画面本身就在跟着变, 不显示预览
+    if (isSliderDown()) {
+        _hoverX = -1;
+        _preview->hide();
+    }else {
+        _hoverX = ev->pos().x();
+        showPreview(_hoverX);
+    }
+}
+
+void VideoSlider::leaveEvent(QEvent *ev) {
+    _hoverX = -1;
+    _preview->hide();
+    QSlider::leaveEvent(ev);
+}
+
+void VideoSlider::setThumbnails(ThumbnailStrip *thumbnails) {
+    if (_thumbnails) {
+        disconnect(_thumbnails, nullptr, this, nullptr);
+    }
+    _thumbnails = thumbnails;
+    if (!_thumbnails) return;
+    // 在工作线程发出, 回到界面线程处理; 悬停的位置刚生成好缩略图就马上显示, 不用等鼠标再移动
+    connect(_thumbnails, &ThumbnailStrip::thumbnailReady, this, [this]() {
+        if (_hoverX >= 0 && !isSliderDown()) {
+            showPreview(_hoverX);
+        }
+    });
+}
+
+void VideoSlider::showPreview(int x) {
+    if (!_thumbnails || !isEnabled()) return;
+
+    int value = QStyle::sliderValueFromPosition(minimum(), maximum(), x, width());
+    QImage image = _thumbnails->find(value);
+    // 这个位置的缩略图还没生成
+    if (image.isNull()) {
+        _preview->hide();
+        return;
+    }
+    _preview->setPixmap(QPixmap::fromImage(image));
+    _preview->resize(image.size());
+    // 显示在鼠标正上方
+    _preview->move(mapToGlobal(QPoint(x - image.width() / 2, -image.height() - 4)));
+    _preview->show();
+}
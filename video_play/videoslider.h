@@ -2,6 +2,8 @@
 #define VIDEOSLIDER_H
 
 #include <QSlider>
+#include <QLabel>
+#include "thumbnailstrip.h"
 
 
 class VideoSlider : public QSlider
@@ -10,8 +12,26 @@ class VideoSlider : public QSlider
 public:
     explicit VideoSlider(QWidget *parent = nullptr);
     void mousePressEvent(QMouseEvent *ev);
+    void mouseMoveEvent(QMouseEvent *ev);
+    void leaveEvent(QEvent *ev);
+    /** 设置悬停预览用的缩略图, 为空不显示预览*/
+    void setThumbnails(ThumbnailStrip *thumbnails);
 signals:
     void clicked(VideoSlider *slider);
+    /** 拖动中位置变了*/
+    void dragged(VideoSlider *slider);
+    /** 拖动结束松开*/
+    void released(VideoSlider *slider);
+
+private:
+    ThumbnailStrip *_thumbnails = nullptr;
+    /** 悬停预览的浮窗*/
+    QLabel *_preview = nullptr;
+    /** 鼠标悬停的x位置, -1是没有悬停(离开、拖动中)*/
+    int _hoverX = -1;
+
+    /** 在鼠标x位置上方显示对应时间的缩略图*/
+    void showPreview(int x);
 
 };
 
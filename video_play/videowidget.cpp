@@ -1,6 +1,11 @@
 #include "videowidget.h"
 #include <QDebug>
 #include <QPainter>
+#include <QGuiApplication>
+#include <QScreen>
+
+// 取不到屏幕刷新率时按这个刷新率限制重绘
+#define DEFAULT_REFRESH_RATE 60
 
 /**
  * 负责显示(渲染)数据
@@ -10,79 +15,183 @@ VideoWidget::VideoWidget(QWidget *parent) : QWidget(parent)
     // 背景黑色
     setAttribute(Qt::WA_StyledBackground);
     setStyleSheet("background: back");
+    // 延后的重绘只触发一次
+    _repaintTimer.setSingleShot(true);
+    connect(&_repaintTimer, &QTimer::timeout, this, [this]() {
+        update();
+    });
     qDebug() << "VideoWidget";
 }
 VideoWidget::~VideoWidget() {
     freeImage();
 }
+void VideoWidget::setStatsOverlay(bool enabled) {
+    _statsOverlay = enabled;
+    update();
+}
+bool VideoWidget::isStatsOverlay() {
+    return _statsOverlay;
+}
 // 渲染
 void VideoWidget::paintEvent(QPaintEvent *event) {
+    // 取信箱里最新的画面, 中间被覆盖的画面在放入时就已经归还缓冲池
+    takeFrame();
     if (!_frame) return;
-    QPainter(this).drawImage(_rect, *_frame);
+    TRACE_THREAD("gui");
+    TRACE_SCOPE("paint", -1);
+    QPainter painter(this);
+    int64_t paintStart = av_gettime_relative();
+    painter.drawImage(_rect, *_frame);
+    if (_player) {
+        _player->recordStageTime(VideoPlayer::StagePaint, av_gettime_relative() - paintStart);
+    }
+
+    if (_statsOverlay && _player) {
+        drawStats(painter);
+    }
+}
+void VideoWidget::drawStats(QPainter &painter) {
+    VideoPlayer::PlaybackStats stats = _player->getPlaybackStats();
+    QStringList lines;
+    // 各阶段耗时 单位是毫秒
+    for (int i = 0; i < VideoPlayer::StageCount; i++) {
+        LatencyHistogram::Summary &summary = stats.stages[i];
+        lines << QString("%1 p50 %2 p99 %3 max %4")
+                 .arg(VideoPlayer::stageName((VideoPlayer::Stage)i), -8)
+                 .arg(summary.p50 / 1000.0, 0, 'f', 2)
+                 .arg(summary.p99 / 1000.0, 0, 'f', 2)
+                 .arg(summary.max / 1000.0, 0, 'f', 2);
+    }
+    lines << QString("queue audio %1 video %2 frame %3")
+             .arg(stats.audioPktQueueSize)
+             .arg(stats.videoPktQueueSize)
+             .arg(stats.videoFrameQueueSize);
+    lines << QString("drift %1 max %2 dropped %3 superseded %4")
+             .arg(stats.avDrift / 1000.0, 0, 'f', 1)
+             .arg(stats.maxAvDrift / 1000.0, 0, 'f', 1)
+             .arg(stats.droppedFrames)
+             .arg(stats.supersededFrames);
+    lines << QString("underruns %1 latency %2 degrade %3")
+             .arg(stats.audioUnderruns)
+             .arg(stats.audioLatency / 1000.0, 0, 'f', 1)
+             .arg(stats.degradeLevel);
+    QString text = lines.join("\n");
+
+    // 半透明底色, 亮的画面上也看得清
+    QFont font("Menlo");
+    font.setStyleHint(QFont::Monospace);
+    font.setPointSize(10);
+    painter.setFont(font);
+    QRect box = painter.boundingRect(rect().adjusted(8, 8, -8, -8), Qt::AlignLeft | Qt::AlignTop, text);
+    painter.fillRect(box.adjusted(-4, -4, 4, 4), QColor(0, 0, 0, 160));
+    painter.setPen(QColor(255, 255, 255));
+    painter.drawText(box, Qt::AlignLeft | Qt::AlignTop, text);
 }
 void VideoWidget::onPlayerVideoStatc(VideoPlayer *player) {
     if (player->getStatc() != VideoPlayer::Stopped) return;
     freeImage();
+    _repaintTimer.stop();
     update();
     qDebug() << "VideoWidget::onPlayerVideoStatc";
 }
-// 接受视频frame
-void VideoWidget::frameDecoded(VideoPlayer *player,
-                               uint8_t *data,
-                               VideoPlayer::VideoSwsSpec &spec) {
+// 有新画面
+void VideoWidget::frameAvailable(VideoPlayer *player) {
+    TRACE_INSTANT("frame available", -1);
+    _player = player;
+
+    // 按屏幕刷新率限制重绘, 一个刷新周期内来的多帧只画最新的一帧
+    QScreen *screen = QGuiApplication::primaryScreen();
+    qreal refreshRate = screen ? screen->refreshRate() : 0;
+    if (refreshRate <= 0) {
+        refreshRate = DEFAULT_REFRESH_RATE;
+    }
+    int64_t wait = _lastFrameTime + (int64_t)(1000000 / refreshRate) - av_gettime_relative();
+    if (wait <= 0) {
+        update();
+    }else if (!_repaintTimer.isActive()) {
+        _repaintTimer.start(wait / 1000 + 1);
+    }
+}
+
+void VideoWidget::takeFrame() {
+    if (!_player) return;
+    FrameQueue::Frame frame;
+    if (!_player->takeVideoFrame(frame)) return;
+    if (_player->getStatc() == VideoPlayer::Stopped) {
+        av_buffer_unref(&frame.buf);
+        return;
+    }
+    // 从显示线程放入信箱到界面线程取走的耗时
+    int64_t now = av_gettime_relative();
+    _player->recordStageTime(VideoPlayer::StageHandoff, now - frame.queuedTime);
+    _lastFrameTime = now;
+    // 屏幕缩放比例可能变了(移到另一个屏幕), 每帧都同步一次
+    updateOutputSize();
 
-    if (player->getStatc() == VideoPlayer::Stopped) return;
     // 释放上一张图片
     freeImage();
-    // 创建新图片
-    if (data != nullptr) {
+    // 创建新图片, 直接使用播放器缓冲池里的内存, 不拷贝
+    _frameBuf = frame.buf;
+    _frame = new QImage(frame.buf->data,
+                        frame.width, frame.height,
+                        QImage::Format_RGB32);
+    updateRect();
+}
+
+void VideoWidget::resizeEvent(QResizeEvent *event) {
+    // 马上让播放器按新的大小重建转换, 暂停中改变大小也不用等下一帧到来
+    updateOutputSize();
+    // 新大小的帧到来之前, 先按新的大小显示当前帧
+    updateRect();
+    QWidget::resizeEvent(event);
+}
 
-        _frame = new QImage(data,
-                            spec.width ,spec.height,
-                            QImage::Format_RGB888);
+void VideoWidget::updateOutputSize() {
+    if (!_player) return;
+    qreal dpr = devicePixelRatioF();
+    _player->setVideoOutputSize(width() * dpr, height() * dpr);
+}
 
-        // 视频适应播放器宽高比
-        int w = width();
-        int h = height();
+void VideoWidget::updateRect() {
+    if (!_frame) return;
 
-        int dstX = 0;
-        int dstY = 0;
-        int dstW = spec.width;
-        int dstH = spec.height;
+    // 视频适应播放器宽高比
+    int w = width();
+    int h = height();
 
-//        qDebug() << dstX << dstY << dstW << dstH;
-        // 如果视频宽或者高超过播放器
-        if (dstW > w || dstH > h) {
-            /*
-             * 视频宽高比大于播放器宽高比, 这里可以说视频的宽比播放器宽大,因为数学上比数意义等于每份高的宽多少, 比数大在也可以说谁的宽度大
-             * dstW / dstH > w / h 方便计算小数位, 进行换算等价 dstw * h > w * dstH
-             */
-            if (dstW * h > w * dstH) {
-                dstH = w * dstH / dstW;
-                dstW = w;
-            }else { // 视频宽高比小于播放器宽高比, 也就是说视频高比播放器长
-                dstW = h * dstW / dstH;
-                dstH = h;
-            }
+    // 图片是物理像素, 换算成逻辑像素, 大小刚好时drawImage不需要缩放
+    qreal dpr = devicePixelRatioF();
+    int dstX = 0;
+    int dstY = 0;
+    int dstW = _frame->width() / dpr;
+    int dstH = _frame->height() / dpr;
 
+    // 如果视频宽或者高超过播放器
+    if (dstW > w || dstH > h) {
+        /*
+         * 视频宽高比大于播放器宽高比, 这里可以说视频的宽比播放器宽大,因为数学上比数意义等于每份高的宽多少, 比数大在也可以说谁的宽度大
+         * dstW / dstH > w / h 方便计算小数位, 进行换算等价 dstw * h > w * dstH
+         */
+        if (dstW * h > w * dstH) {
+            dstH = w * dstH / dstW;
+            dstW = w;
+        }else { // 视频宽高比小于播放器宽高比, 也就是说视频高比播放器长
+            dstW = h * dstW / dstH;
+            dstH = h;
         }
-        // 设置屏幕居中
-        dstX = (w - dstW) >> 1;
-        dstY = (h - dstH) >> 1;
-        _rect = QRect(dstX, dstY, dstW, dstH);
-
 
     }
-
-    // 重绘
-    update();
-
+    // 设置屏幕居中
+    dstX = (w - dstW) >> 1;
+    dstY = (h - dstH) >> 1;
+    _rect = QRect(dstX, dstY, dstW, dstH);
 }
 
 void VideoWidget::freeImage() {
     if (_frame) {
-        av_free(_frame->bits());
         delete _frame;
         _frame = nullptr;
     }
+    // 缓冲回到播放器的缓冲池
+    av_buffer_unref(&_frameBuf);
 }
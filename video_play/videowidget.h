@@ -2,6 +2,8 @@
 #define VIDEOWIDGET_H
 
 #include <QWidget>
+#include <QPainter>
+#include <QTimer>
 #include "videoplayer.h"
 
 class VideoWidget : public QWidget
@@ -10,18 +12,42 @@ class VideoWidget : public QWidget
 public:
     explicit VideoWidget(QWidget *parent = nullptr);
     ~VideoWidget();
+    /** 设置是否在画面上显示播放统计*/
+    void setStatsOverlay(bool enabled);
+    /** 是否显示播放统计*/
+    bool isStatsOverlay();
 
 signals:
 public slots:
-    void frameDecoded(VideoPlayer *player, uint8_t *data, VideoPlayer::VideoSwsSpec &vSwsOutSpec);
+    /** 播放器有新画面, 按屏幕刷新率安排重绘, 重绘时再取最新的一帧*/
+    void frameAvailable(VideoPlayer *player);
     void onPlayerVideoStatc(VideoPlayer *player);
 private:
 
     QImage *_frame = nullptr;
+    /** 图片使用的播放器缓冲, 显示下一帧时释放引用归还缓冲池*/
+    AVBufferRef *_frameBuf = nullptr;
     QRect _rect;
+    /** 正在显示的播放器, 记录交接和绘制耗时、取播放统计*/
+    VideoPlayer *_player = nullptr;
+    /** 是否显示播放统计*/
+    bool _statsOverlay = false;
+    /** 离上次换画面不到一个刷新周期时, 延后重绘的定时器*/
+    QTimer _repaintTimer;
+    /** 上次换画面的时刻 单位是微妙*/
+    int64_t _lastFrameTime = 0;
 
     void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
     void freeImage();
+    /** 从播放器的信箱取最新的画面, 没有新画面保留当前的*/
+    void takeFrame();
+    /** 在左上角绘制播放统计*/
+    void drawStats(QPainter &painter);
+    /** 计算图片居中显示的区域*/
+    void updateRect();
+    /** 告诉播放器显示区域的物理像素大小, 之后的帧直接转换成这个大小*/
+    void updateOutputSize();
 };
 
 #endif // VIDEOWIDGET_H
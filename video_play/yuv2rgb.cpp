@@ -0,0 +1,399 @@
+#include "yuv2rgb.h"
+#include <string.h>
+extern "C" {
+#include <libavutil/cpu.h>
+}
+
+// 只在x86上提供SIMD实现, 用函数级别的target属性编译, 不需要给整个工程加-mavx2之类的编译选项
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define YUV2RGB_X86 1
+#include <immintrin.h>
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#elif defined(_M_X64)
+#define YUV2RGB_X86 1
+#include <immintrin.h>
+#define TARGET_SSE41
+#define TARGET_AVX2
+#define TARGET_AVX512
+#endif
+
+// 输入格式(都是420采样)
+#define FMT_I420 0 // yuv420p, yuvj420p
+#define FMT_NV12 1 // nv12
+#define FMT_I010 2 // yuv420p10
+
+// 定点系数(放大2^shift倍)
+typedef struct {
+    int cy, crv, cgu, cgv, cbu;
+    int yOffset, cOffset;
+    int shift;
+    int round;
+} Coeffs;
+
+// BT.601 有限范围 8位
+static const Coeffs COEFFS_LIMITED_8 = {19077, 26149, 6419, 13320, 33050, 16, 128, 14, 1 << 13};
+// BT.601 全范围 8位(yuvj)
+static const Coeffs COEFFS_FULL_8 = {16384, 22970, 5638, 11700, 29032, 0, 128, 14, 1 << 13};
+// BT.601 有限范围 10位, 样本是8位的4倍, 多右移2位
+static const Coeffs COEFFS_LIMITED_10 = {19077, 26149, 6419, 13320, 33050, 64, 512, 16, 1 << 15};
+
+// 一行的转换函数, nv12时u是交错的uv, v不用
+typedef void (*RowFunc)(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                        uint32_t *dst, int width, const Coeffs &c);
+
+#pragma mark - C实现
+static inline int clampPixel(int x) {
+    return x < 0 ? 0 : (x > 255 ? 255 : x);
+}
+
+static inline uint32_t yuvPixel(int y, int u, int v, const Coeffs &c) {
+    y = (y - c.yOffset) * c.cy + c.round;
+    u -= c.cOffset;
+    v -= c.cOffset;
+    int r = clampPixel((y + c.crv * v) >> c.shift);
+    int g = clampPixel((y - c.cgu * u - c.cgv * v) >> c.shift);
+    int b = clampPixel((y + c.cbu * u) >> c.shift);
+    // AV_PIX_FMT_RGB32是本机字节序的ARGB, 直接按32位整数写
+    return 0xFF000000u | (uint32_t)r << 16 | (uint32_t)g << 8 | (uint32_t)b;
+}
+
+// 从第x个像素开始转换到行尾, 也用来处理SIMD剩下的像素
+template<int FMT>
+static void rowC(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                 uint32_t *dst, int x, int width, const Coeffs &c) {
+    for (; x < width; x++) {
+        int cy, cu, cv;
+        if (FMT == FMT_I010) {
+            cy = ((const uint16_t *)y)[x];
+            cu = ((const uint16_t *)u)[x >> 1];
+            cv = ((const uint16_t *)v)[x >> 1];
+        }else if (FMT == FMT_NV12) {
+            cy = y[x];
+            cu = u[x >> 1 << 1];
+            cv = u[(x >> 1 << 1) + 1];
+        }else {
+            cy = y[x];
+            cu = u[x >> 1];
+            cv = v[x >> 1];
+        }
+        dst[x] = yuvPixel(cy, cu, cv, c);
+    }
+}
+
+#ifdef YUV2RGB_X86
+static inline int32_t load32(const void *p) {
+    int32_t x;
+    memcpy(&x, p, sizeof(x));
+    return x;
+}
+
+static inline uint16_t load16(const void *p) {
+    uint16_t x;
+    memcpy(&x, p, sizeof(x));
+    return x;
+}
+
+#pragma mark - SSE4.1 一次4个像素
+typedef struct {
+    __m128i yOffset, cOffset, cy, crv, cgu, cgv, cbu, round, shift, max, alpha;
+} CoeffsSse41;
+
+TARGET_SSE41 static inline CoeffsSse41 coeffsSse41(const Coeffs &c) {
+    CoeffsSse41 k;
+    k.yOffset = _mm_set1_epi32(c.yOffset);
+    k.cOffset = _mm_set1_epi32(c.cOffset);
+    k.cy = _mm_set1_epi32(c.cy);
+    k.crv = _mm_set1_epi32(c.crv);
+    k.cgu = _mm_set1_epi32(c.cgu);
+    k.cgv = _mm_set1_epi32(c.cgv);
+    k.cbu = _mm_set1_epi32(c.cbu);
+    k.round = _mm_set1_epi32(c.round);
+    k.shift = _mm_cvtsi32_si128(c.shift);
+    k.max = _mm_set1_epi32(255);
+    k.alpha = _mm_set1_epi32((int)0xFF000000);
+    return k;
+}
+
+TARGET_SSE41 static inline __m128i pixelsSse41(__m128i y, __m128i u, __m128i v, const CoeffsSse41 &k) {
+    y = _mm_add_epi32(_mm_mullo_epi32(_mm_sub_epi32(y, k.yOffset), k.cy), k.round);
+    u = _mm_sub_epi32(u, k.cOffset);
+    v = _mm_sub_epi32(v, k.cOffset);
+    __m128i zero = _mm_setzero_si128();
+    __m128i r = _mm_sra_epi32(_mm_add_epi32(y, _mm_mullo_epi32(v, k.crv)), k.shift);
+    __m128i g = _mm_sra_epi32(_mm_sub_epi32(_mm_sub_epi32(y, _mm_mullo_epi32(u, k.cgu)),
+                                            _mm_mullo_epi32(v, k.cgv)), k.shift);
+    __m128i b = _mm_sra_epi32(_mm_add_epi32(y, _mm_mullo_epi32(u, k.cbu)), k.shift);
+    r = _mm_min_epi32(_mm_max_epi32(r, zero), k.max);
+    g = _mm_min_epi32(_mm_max_epi32(g, zero), k.max);
+    b = _mm_min_epi32(_mm_max_epi32(b, zero), k.max);
+    return _mm_or_si128(_mm_or_si128(b, _mm_slli_epi32(g, 8)),
+                        _mm_or_si128(_mm_slli_epi32(r, 16), k.alpha));
+}
+
+template<int FMT>
+TARGET_SSE41 static void rowSse41(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                                  uint32_t *dst, int width, const Coeffs &c) {
+    CoeffsSse41 k = coeffsSse41(c);
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        __m128i vy, vu, vv;
+        if (FMT == FMT_I010) {
+            vy = _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i *)((const uint16_t *)y + x)));
+            vu = _mm_cvtepu16_epi32(_mm_cvtsi32_si128(load32((const uint16_t *)u + (x >> 1))));
+            vv = _mm_cvtepu16_epi32(_mm_cvtsi32_si128(load32((const uint16_t *)v + (x >> 1))));
+            // 色度水平方向每个样本用两次
+            vu = _mm_unpacklo_epi32(vu, vu);
+            vv = _mm_unpacklo_epi32(vv, vv);
+        }else if (FMT == FMT_NV12) {
+            vy = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(load32(y + x)));
+            __m128i uv = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(load32(u + x)));
+            vu = _mm_shuffle_epi32(uv, _MM_SHUFFLE(2, 2, 0, 0));
+            vv = _mm_shuffle_epi32(uv, _MM_SHUFFLE(3, 3, 1, 1));
+        }else {
+            vy = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(load32(y + x)));
+            vu = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(load16(u + (x >> 1))));
+            vv = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(load16(v + (x >> 1))));
+            vu = _mm_unpacklo_epi32(vu, vu);
+            vv = _mm_unpacklo_epi32(vv, vv);
+        }
+        _mm_storeu_si128((__m128i *)(dst + x), pixelsSse41(vy, vu, vv, k));
+    }
+    rowC<FMT>(y, u, v, dst, x, width, c);
+}
+
+#pragma mark - AVX2 一次8个像素
+typedef struct {
+    __m256i yOffset, cOffset, cy, crv, cgu, cgv, cbu, round, max, alpha;
+    __m128i shift;
+} CoeffsAvx2;
+
+TARGET_AVX2 static inline CoeffsAvx2 coeffsAvx2(const Coeffs &c) {
+    CoeffsAvx2 k;
+    k.yOffset = _mm256_set1_epi32(c.yOffset);
+    k.cOffset = _mm256_set1_epi32(c.cOffset);
+    k.cy = _mm256_set1_epi32(c.cy);
+    k.crv = _mm256_set1_epi32(c.crv);
+    k.cgu = _mm256_set1_epi32(c.cgu);
+    k.cgv = _mm256_set1_epi32(c.cgv);
+    k.cbu = _mm256_set1_epi32(c.cbu);
+    k.round = _mm256_set1_epi32(c.round);
+    k.shift = _mm_cvtsi32_si128(c.shift);
+    k.max = _mm256_set1_epi32(255);
+    k.alpha = _mm256_set1_epi32((int)0xFF000000);
+    return k;
+}
+
+TARGET_AVX2 static inline __m256i pixelsAvx2(__m256i y, __m256i u, __m256i v, const CoeffsAvx2 &k) {
+    y = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(y, k.yOffset), k.cy), k.round);
+    u = _mm256_sub_epi32(u, k.cOffset);
+    v = _mm256_sub_epi32(v, k.cOffset);
+    __m256i zero = _mm256_setzero_si256();
+    __m256i r = _mm256_sra_epi32(_mm256_add_epi32(y, _mm256_mullo_epi32(v, k.crv)), k.shift);
+    __m256i g = _mm256_sra_epi32(_mm256_sub_epi32(_mm256_sub_epi32(y, _mm256_mullo_epi32(u, k.cgu)),
+                                                  _mm256_mullo_epi32(v, k.cgv)), k.shift);
+    __m256i b = _mm256_sra_epi32(_mm256_add_epi32(y, _mm256_mullo_epi32(u, k.cbu)), k.shift);
+    r = _mm256_min_epi32(_mm256_max_epi32(r, zero), k.max);
+    g = _mm256_min_epi32(_mm256_max_epi32(g, zero), k.max);
+    b = _mm256_min_epi32(_mm256_max_epi32(b, zero), k.max);
+    return _mm256_or_si256(_mm256_or_si256(b, _mm256_slli_epi32(g, 8)),
+                           _mm256_or_si256(_mm256_slli_epi32(r, 16), k.alpha));
+}
+
+template<int FMT>
+TARGET_AVX2 static void rowAvx2(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                                uint32_t *dst, int width, const Coeffs &c) {
+    CoeffsAvx2 k = coeffsAvx2(c);
+    // 色度水平方向每个样本用两次
+    const __m256i dup = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+    const __m256i evens = _mm256_setr_epi32(0, 0, 2, 2, 4, 4, 6, 6);
+    const __m256i odds = _mm256_setr_epi32(1, 1, 3, 3, 5, 5, 7, 7);
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m256i vy, vu, vv;
+        if (FMT == FMT_I010) {
+            vy = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)((const uint16_t *)y + x)));
+            vu = _mm256_cvtepu16_epi32(_mm_loadl_epi64((const __m128i *)((const uint16_t *)u + (x >> 1))));
+            vv = _mm256_cvtepu16_epi32(_mm_loadl_epi64((const __m128i *)((const uint16_t *)v + (x >> 1))));
+            vu = _mm256_permutevar8x32_epi32(vu, dup);
+            vv = _mm256_permutevar8x32_epi32(vv, dup);
+        }else if (FMT == FMT_NV12) {
+            vy = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(y + x)));
+            __m256i uv = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(u + x)));
+            vu = _mm256_permutevar8x32_epi32(uv, evens);
+            vv = _mm256_permutevar8x32_epi32(uv, odds);
+        }else {
+            vy = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(y + x)));
+            vu = _mm256_cvtepu8_epi32(_mm_cvtsi32_si128(load32(u + (x >> 1))));
+            vv = _mm256_cvtepu8_epi32(_mm_cvtsi32_si128(load32(v + (x >> 1))));
+            vu = _mm256_permutevar8x32_epi32(vu, dup);
+            vv = _mm256_permutevar8x32_epi32(vv, dup);
+        }
+        _mm256_storeu_si256((__m256i *)(dst + x), pixelsAvx2(vy, vu, vv, k));
+    }
+    rowC<FMT>(y, u, v, dst, x, width, c);
+}
+
+#pragma mark - AVX-512 一次16个像素
+typedef struct {
+    __m512i yOffset, cOffset, cy, crv, cgu, cgv, cbu, round, max, alpha;
+    __m128i shift;
+} CoeffsAvx512;
+
+TARGET_AVX512 static inline CoeffsAvx512 coeffsAvx512(const Coeffs &c) {
+    CoeffsAvx512 k;
+    k.yOffset = _mm512_set1_epi32(c.yOffset);
+    k.cOffset = _mm512_set1_epi32(c.cOffset);
+    k.cy = _mm512_set1_epi32(c.cy);
+    k.crv = _mm512_set1_epi32(c.crv);
+    k.cgu = _mm512_set1_epi32(c.cgu);
+    k.cgv = _mm512_set1_epi32(c.cgv);
+    k.cbu = _mm512_set1_epi32(c.cbu);
+    k.round = _mm512_set1_epi32(c.round);
+    k.shift = _mm_cvtsi32_si128(c.shift);
+    k.max = _mm512_set1_epi32(255);
+    k.alpha = _mm512_set1_epi32((int)0xFF000000);
+    return k;
+}
+
+TARGET_AVX512 static inline __m512i pixelsAvx512(__m512i y, __m512i u, __m512i v, const CoeffsAvx512 &k) {
+    y = _mm512_add_epi32(_mm512_mullo_epi32(_mm512_sub_epi32(y, k.yOffset), k.cy), k.round);
+    u = _mm512_sub_epi32(u, k.cOffset);
+    v = _mm512_sub_epi32(v, k.cOffset);
+    __m512i zero = _mm512_setzero_si512();
+    __m512i r = _mm512_sra_epi32(_mm512_add_epi32(y, _mm512_mullo_epi32(v, k.crv)), k.shift);
+    __m512i g = _mm512_sra_epi32(_mm512_sub_epi32(_mm512_sub_epi32(y, _mm512_mullo_epi32(u, k.cgu)),
+                                                  _mm512_mullo_epi32(v, k.cgv)), k.shift);
+    __m512i b = _mm512_sra_epi32(_mm512_add_epi32(y, _mm512_mullo_epi32(u, k.cbu)), k.shift);
+    r = _mm512_min_epi32(_mm512_max_epi32(r, zero), k.max);
+    g = _mm512_min_epi32(_mm512_max_epi32(g, zero), k.max);
+    b = _mm512_min_epi32(_mm512_max_epi32(b, zero), k.max);
+    return _mm512_or_si512(_mm512_or_si512(b, _mm512_slli_epi32(g, 8)),
+                           _mm512_or_si512(_mm512_slli_epi32(r, 16), k.alpha));
+}
+
+template<int FMT>
+TARGET_AVX512 static void rowAvx512(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                                    uint32_t *dst, int width, const Coeffs &c) {
+    CoeffsAvx512 k = coeffsAvx512(c);
+    const __m512i dup = _mm512_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7);
+    const __m512i evens = _mm512_setr_epi32(0, 0, 2, 2, 4, 4, 6, 6, 8, 8, 10, 10, 12, 12, 14, 14);
+    const __m512i odds = _mm512_setr_epi32(1, 1, 3, 3, 5, 5, 7, 7, 9, 9, 11, 11, 13, 13, 15, 15);
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m512i vy, vu, vv;
+        if (FMT == FMT_I010) {
+            vy = _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i *)((const uint16_t *)y + x)));
+            vu = _mm512_castsi256_si512(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)((const uint16_t *)u + (x >> 1)))));
+            vv = _mm512_castsi256_si512(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)((const uint16_t *)v + (x >> 1)))));
+            vu = _mm512_permutexvar_epi32(dup, vu);
+            vv = _mm512_permutexvar_epi32(dup, vv);
+        }else if (FMT == FMT_NV12) {
+            vy = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *)(y + x)));
+            __m512i uv = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *)(u + x)));
+            vu = _mm512_permutexvar_epi32(evens, uv);
+            vv = _mm512_permutexvar_epi32(odds, uv);
+        }else {
+            vy = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *)(y + x)));
+            vu = _mm512_castsi256_si512(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(u + (x >> 1)))));
+            vv = _mm512_castsi256_si512(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(v + (x >> 1)))));
+            vu = _mm512_permutexvar_epi32(dup, vu);
+            vv = _mm512_permutexvar_epi32(dup, vv);
+        }
+        _mm512_storeu_si512((void *)(dst + x), pixelsAvx512(vy, vu, vv, k));
+    }
+    rowC<FMT>(y, u, v, dst, x, width, c);
+}
+#endif
+
+#pragma mark - 分派
+static Yuv2Rgb::Isa detectIsa() {
+#ifdef YUV2RGB_X86
+    // 用ffmpeg的检测, 已经考虑了操作系统是否开启AVX寄存器保存
+    int flags = av_get_cpu_flags();
+#ifdef AV_CPU_FLAG_AVX512
+    if (flags & AV_CPU_FLAG_AVX512) return Yuv2Rgb::AVX512;
+#endif
+    if (flags & AV_CPU_FLAG_AVX2) return Yuv2Rgb::AVX2;
+    if (flags & AV_CPU_FLAG_SSE4) return Yuv2Rgb::SSE41;
+#endif
+    return Yuv2Rgb::None;
+}
+
+static RowFunc rowFunc(Yuv2Rgb::Isa isa, int fmt) {
+#ifdef YUV2RGB_X86
+    static const RowFunc funcs[][3] = {
+        {rowSse41<FMT_I420>, rowSse41<FMT_NV12>, rowSse41<FMT_I010>},
+        {rowAvx2<FMT_I420>, rowAvx2<FMT_NV12>, rowAvx2<FMT_I010>},
+        {rowAvx512<FMT_I420>, rowAvx512<FMT_NV12>, rowAvx512<FMT_I010>},
+    };
+    if (isa != Yuv2Rgb::None) return funcs[isa - Yuv2Rgb::SSE41][fmt];
+#endif
+    return nullptr;
+}
+
+Yuv2Rgb::Isa Yuv2Rgb::isa() {
+    // 局部静态变量只初始化一次, 多线程安全
+    static Isa isa = detectIsa();
+    return isa;
+}
+
+const char *Yuv2Rgb::isaName(Isa isa) {
+    switch (isa) {
+    case SSE41: return "sse4.1";
+    case AVX2: return "avx2";
+    case AVX512: return "avx512";
+    default: return "none";
+    }
+}
+
+bool Yuv2Rgb::isSupported(int srcFmt) {
+    if (isa() == None) return false;
+    return srcFmt == AV_PIX_FMT_YUV420P
+            || srcFmt == AV_PIX_FMT_YUVJ420P
+            || srcFmt == AV_PIX_FMT_NV12
+            || srcFmt == AV_PIX_FMT_YUV420P10;
+}
+
+bool Yuv2Rgb::convert(const AVFrame *src, int y, int h, uint8_t *dst, int dstLinesize) {
+    return convert(src, y, h, dst, dstLinesize, isa());
+}
+
+bool Yuv2Rgb::convert(const AVFrame *src, int y, int h, uint8_t *dst, int dstLinesize, Isa isa) {
+    if (isa > Yuv2Rgb::isa()) return false;
+
+    int fmt;
+    const Coeffs *c;
+    switch (src->format) {
+    case AV_PIX_FMT_YUV420P:
+        fmt = FMT_I420;
+        c = &COEFFS_LIMITED_8;
+        break;
+    case AV_PIX_FMT_YUVJ420P:
+        fmt = FMT_I420;
+        c = &COEFFS_FULL_8;
+        break;
+    case AV_PIX_FMT_NV12:
+        fmt = FMT_NV12;
+        c = &COEFFS_LIMITED_8;
+        break;
+    case AV_PIX_FMT_YUV420P10:
+        fmt = FMT_I010;
+        c = &COEFFS_LIMITED_10;
+        break;
+    default:
+        return false;
+    }
+    RowFunc func = rowFunc(isa, fmt);
+    if (!func) return false;
+
+    for (int row = y; row < y + h; row++) {
+        // 420两行亮度共用一行色度
+        const uint8_t *yRow = src->data[0] + row * src->linesize[0];
+        const uint8_t *uRow = src->data[1] + (row >> 1) * src->linesize[1];
+        const uint8_t *vRow = fmt == FMT_NV12 ? nullptr : src->data[2] + (row >> 1) * src->linesize[2];
+        func(yRow, uRow, vRow, (uint32_t *)(dst + row * dstLinesize), src->width, *c);
+    }
+    return true;
+}
@@ -0,0 +1,38 @@
+#ifndef YUV2RGB_H
+#define YUV2RGB_H
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+}
+
+/**
+ * 不缩放的YUV转RGB32专用转换
+ * 常见的yuv420p(yuvj420p)、nv12、yuv420p10输入, 按运行时检测到的CPU指令集(SSE4.1/AVX2/AVX-512)选择SIMD实现,
+ * 不支持的格式或CPU由外界回退到sws_scale.
+ * 系数和swscale默认一致(BT.601, yuvj为全范围), 切换到sws_scale时颜色不会跳变.
+ */
+class Yuv2Rgb
+{
+public:
+    // 指令集
+    typedef enum {
+        None = 0,
+        SSE41,
+        AVX2,
+        AVX512
+    } Isa;
+
+    /** 当前CPU能用的最快指令集(只检测一次)*/
+    static Isa isa();
+    /** 指令集名称, 用于打印*/
+    static const char *isaName(Isa isa);
+    /** 能否把这种格式不缩放地转换成AV_PIX_FMT_RGB32*/
+    static bool isSupported(int srcFmt);
+    /** 转换src从第y行开始的h行, 写到dst对应的行(dst是整帧起始地址), 不支持返回false*/
+    static bool convert(const AVFrame *src, int y, int h, uint8_t *dst, int dstLinesize);
+    /** 指定指令集转换(测试用), 比当前CPU能用的指令集高返回false*/
+    static bool convert(const AVFrame *src, int y, int h, uint8_t *dst, int dstLinesize, Isa isa);
+};
+
+#endif // YUV2RGB_H